@@ -0,0 +1,479 @@
+/***
+ * Notepad--
+ * Written by Ian Kinsella
+ * The benchmarks, built into notepadmm-bench by make bench. They drive the editing core without a terminal and
+ * aren't part of libnotepadmm
+ */
+
+#include "notepadmm.h" //the editing core's functions
+#include "libnotepadmm.h" //opening and closing files
+#include "keywords.h" //the built in keyword sets, for the strstr search to compare against
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*** Defines ***/
+#define SEARCH_BLOCK (1L * 1024 * 1024) //bytes of whole lines the search benchmark searches at a time
+#define MAX_QUERY 256 //size of the editor's search query, a longer literal is cut short
+
+/*** Structures ***/
+struct getline_row {
+  /***
+   * A row loaded the way files used to be, for benchGetlineLoad
+   */
+  char *chars;
+  size_t length;
+};
+
+/*** Allocation Counting ***/
+#ifdef COUNT_ALLOCS
+//the bench build links with -Wl,--wrap so every malloc, calloc, realloc and posix_memalign goes through these
+long long allocCount; //allocations since the editor started, the search and save threads count too
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+int __real_posix_memalign(void **ptr, size_t align, size_t size);
+void *__wrap_malloc(size_t size){
+  __atomic_add_fetch(&allocCount, 1, __ATOMIC_RELAXED);
+  return __real_malloc(size);
+}
+void *__wrap_calloc(size_t count, size_t size){
+  __atomic_add_fetch(&allocCount, 1, __ATOMIC_RELAXED);
+  return __real_calloc(count, size);
+}
+void *__wrap_realloc(void *ptr, size_t size){
+  __atomic_add_fetch(&allocCount, 1, __ATOMIC_RELAXED);
+  return __real_realloc(ptr, size);
+}
+int __wrap_posix_memalign(void **ptr, size_t align, size_t size){
+  __atomic_add_fetch(&allocCount, 1, __ATOMIC_RELAXED);
+  return __real_posix_memalign(ptr, align, size);
+}
+#endif
+
+/*** Function Prototypes ***/
+struct getline_row* benchGetlineLoad(char *filename, size_t *numrowsOut);
+void benchLoad(char *filename);
+double benchKeywordTable(const struct keyword_set *set, char **lines, int numLines, size_t bytes, int naive);
+void benchKeywords(char *filename);
+double benchSearchFile(const char *data, size_t size, long long *matches);
+void benchSearch(char *filename, char *literal, char *pattern);
+long long allocations(void);
+int writeFixture(long lines, char *filename);
+size_t repeatKeys(char *buf, size_t at, const char *keys, int times);
+void benchReplay(const char *filename, const char *name, const char *keys, size_t len, int startRow);
+void benchKeys(char *filename);
+int benchRecording(char *filename, char *recording);
+
+/*** Loading ***/
+struct getline_row* benchGetlineLoad(char *filename, size_t *numrowsOut){
+  /***
+   * The way files used to be loaded, one getline() per line, a malloc per row, and a rows array
+   * that is grown one element at a time. Only kept so benchLoad has something to compare against
+   */
+  FILE *file = fopen(filename, "r");
+  if(file == NULL) return NULL;
+  struct getline_row *rows = NULL;
+  size_t numrows = 0;
+  char *line = NULL;
+  size_t len = 0;
+  ssize_t read;
+  while((read = getline(&line, &len, file)) != -1){
+    rows = realloc(rows, sizeof(struct getline_row) * (numrows + 1));
+    if(rows == NULL){
+      printf("Memory allocation failed\n");
+      exit(1);
+    }
+    rows[numrows].length = read > 0 && line[read - 1] == '\n' ? read - 1 : read;
+    rows[numrows].chars = malloc(rows[numrows].length + 1);
+    if(rows[numrows].chars == NULL){
+      printf("Memory allocation failed\n");
+      exit(1);
+    }
+    memcpy(rows[numrows].chars, line, rows[numrows].length);
+    rows[numrows].chars[rows[numrows].length] = '\0';
+    numrows++;
+  }
+  free(line);
+  fclose(file);
+  *numrowsOut = numrows;
+  return rows;
+}
+
+void benchLoad(char *filename){
+  /***
+   * Time loading a file with the old getline loop and with the block loader, plus the newline scan on
+   * its own, and print the throughput of each
+   */
+  size_t size;
+  char *buf = readWholeFile(filename, &size); //also warms up the page cache so every path sees the same thing
+  if(buf == NULL){
+    perror("Error opening file");
+    return;
+  }
+  double start = nowSeconds();
+  countNewlines(buf, size);
+  double scanTime = nowSeconds() - start;
+  free(buf);
+
+  size_t getlineRows = 0;
+  start = nowSeconds();
+  struct getline_row *rows = benchGetlineLoad(filename, &getlineRows);
+  double getlineTime = nowSeconds() - start;
+  for(size_t i = 0; i < getlineRows; i++) free(rows[i].chars);
+  free(rows);
+
+  start = nowSeconds();
+  int blockRows = loadRows(filename);
+  double blockTime = nowSeconds() - start;
+  free_all_rows();
+
+  double gb = size / 1e9;
+  printf("load benchmark: %s, %zu bytes, %d lines, %ld threads\n", filename, size, blockRows, sysconf(_SC_NPROCESSORS_ONLN));
+  printf("%-14s %8.3f s %8.2f GB/s  (%zu rows)\n", "getline", getlineTime, gb / getlineTime, getlineRows);
+  printf("%-14s %8.3f s %8.2f GB/s  (%d rows)\n", "block loader", blockTime, gb / blockTime, blockRows);
+  printf("%-14s %8.3f s %8.2f GB/s\n", "newline scan", scanTime, gb / scanTime);
+}
+
+/*** Keywords ***/
+double benchKeywordTable(const struct keyword_set *set, char **lines, int numLines, size_t bytes, int naive){
+  /***
+   * Time finding the current language's keywords in every line, either with the compiled keyword table or with the
+   * old strstr search for each keyword of set, and return the nanoseconds spent per byte of text
+   */
+  int rounds = 0;
+  long matches = 0;
+  double start = nowSeconds();
+  double elapsed;
+  do{ //repeat until the time is long enough to measure
+    for(int i = 0; i < numLines; i++){
+      if(naive){
+        for(int k = 0; k < set->numWords + set->numOperators; k++){
+          const char *keyword = k < set->numWords ? set->words[k] : set->operators[k - set->numWords];
+          for(char *found = strstr(lines[i], keyword); found != NULL; found = strstr(found + 1, keyword)){
+            matches += checkKeywordHighlight(lines[i], found, strlen(keyword));
+          }
+        }
+      } else {
+        matches += countKeywords(lines[i]);
+      }
+    }
+    rounds++;
+    elapsed = nowSeconds() - start;
+  } while(elapsed < 0.2);
+  if(matches < 0) printf("%ld\n", matches); //keeps the compiler from dropping the search
+  return elapsed * 1e9 / ((double)bytes * rounds);
+}
+
+void benchKeywords(char *filename){
+  /***
+   * Time keyword matching over the lines of a file with the C, C++ and Java keyword tables and print the
+   * cost per byte of the compiled table against the old strstr per keyword search, which always uses the
+   * built in keywords
+   */
+  size_t size;
+  char *buf = readWholeFile(filename, &size);
+  if(buf == NULL){
+    perror("Error opening file");
+    return;
+  }
+  int numLines = 1;
+  for(size_t i = 0; i < size; i++) numLines += buf[i] == '\n';
+  char **lines = malloc(sizeof(char *) * numLines);
+  char *text = malloc(size + 1);
+  if(lines == NULL || text == NULL){
+    printf("Memory allocation failed\n");
+    exit(1);
+  }
+  memcpy(text, buf, size);
+  text[size] = '\0';
+  free(buf);
+  lines[0] = text;
+  int n = 1;
+  for(size_t i = 0; i < size; i++){ //split the text into lines in place
+    if(text[i] == '\n'){
+      text[i] = '\0';
+      lines[n++] = text + i + 1;
+    }
+  }
+
+  char *tables[] = {"ckeyword.txt", "cppkeyword.txt", "javakeyword.txt"};
+  char *languages[] = {"bench.c", "bench.cpp", "bench.java"}; //files highlighted with each table
+  printf("keyword benchmark: %s, %zu bytes, %d lines\n", filename, size, numLines);
+  for(int t = 0; t < 3; t++){
+    const struct keyword_set *set = NULL;
+    for(int i = 0; i < numBuiltinKeywordSets; i++){
+      if(strcmp(builtinKeywordSets[i].name, tables[t]) == 0) set = &builtinKeywordSets[i];
+    }
+    int numKeywords = setLanguage(languages[t]);
+    double tableTime = benchKeywordTable(set, lines, numLines, size, 0);
+    double naiveTime = set != NULL ? benchKeywordTable(set, lines, numLines, size, 1) : 0.0;
+    printf("%-16s %4d keywords  table %7.2f ns/byte  strstr %8.2f ns/byte\n", tables[t], numKeywords, tableTime,
+      naiveTime);
+  }
+  freeLanguages();
+  free(lines);
+  free(text);
+}
+
+/*** Searching ***/
+double benchSearchFile(const char *data, size_t size, long long *matches){
+  /***
+   * Count the matches of the search query in a whole file, a block of lines at a time like the spans of a
+   * mapped file are searched, and return the seconds it took
+   */
+  long long count = 0;
+  double start = nowSeconds();
+  for(size_t pos = 0; pos < size; ){
+    size_t len = size - pos > (size_t)SEARCH_BLOCK ? (size_t)SEARCH_BLOCK : size - pos;
+    if(pos + len < size){ //end the block at its last newline so no line is cut in two
+      size_t cut = len;
+      while(cut > 0 && data[pos + cut - 1] != '\n') cut--;
+      if(cut > 0) len = cut;
+    }
+    count += countQueryMatches(data + pos, len);
+    pos += len;
+  }
+  *matches = count;
+  return nowSeconds() - start;
+}
+
+void benchSearch(char *filename, char *literal, char *pattern){
+  /***
+   * Time counting every match in a file with the plain Boyer-Moore-Horspool search, with the regex engine
+   * searching for the same literal, and with the regex engine on pattern if there is one. The file is mapped
+   * so inputs of many GB don't have to fit in memory
+   */
+  int fd = open(filename, O_RDONLY);
+  struct stat st;
+  if(fd == -1 || fstat(fd, &st) == -1 || st.st_size == 0){
+    perror("Error opening file");
+    return;
+  }
+  size_t size = st.st_size;
+  char *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(data == MAP_FAILED){
+    perror("Error mapping file");
+    return;
+  }
+  madvise(data, size, MADV_SEQUENTIAL);
+
+  char escaped[2 * MAX_QUERY];
+  int n = 0;
+  for(char *c = literal; *c != '\0' && n < MAX_QUERY - 2; c++){ //the literal as a regex that matches only itself
+    if(strchr("\\.[]()*+?|^$", *c) != NULL) escaped[n++] = '\\';
+    escaped[n++] = *c;
+  }
+  escaped[n] = '\0';
+
+  char *names[] = {"literal", "regex literal", "regex"};
+  char *queries[] = {literal, escaped, pattern};
+  long long matches;
+  printf("search benchmark: %s, %zu bytes\n", filename, size);
+  setSearchQuery(literal, 0);
+  benchSearchFile(data, size, &matches); //read the file into the page cache so every search sees the same thing
+  for(int i = 0; i < 3 && queries[i] != NULL; i++){
+    const char *error = setSearchQuery(queries[i], i > 0);
+    if(error != NULL){
+      printf("%-14s bad regex: %s\n", names[i], error);
+      continue;
+    }
+    double time = benchSearchFile(data, size, &matches);
+    printf("%-14s %-24s %10lld matches %8.3f s %8.2f GB/s\n", names[i], queries[i], matches, time, size / 1e9 / time);
+  }
+  setSearchQuery(literal, 0); //frees the last regex
+  munmap(data, size);
+}
+
+/*** Keystrokes ***/
+long long allocations(void){
+  /***
+   * Number of allocations made so far, or -1 if they aren't being counted(only the bench build counts them)
+   */
+#ifdef COUNT_ALLOCS
+  return __atomic_load_n(&allocCount, __ATOMIC_RELAXED);
+#else
+  return -1;
+#endif
+}
+
+int writeFixture(long lines, char *filename){
+  /***
+   * Write a generated C-like file of lines lines for the benchmarks to run on, it has keywords, comments and strings
+   * so highlighting has something to do. Returns the exit code for main
+   */
+  static const char *templates[] = {
+    "int value%ld = compute(%ld, buffer); // running total so far",
+    "/* block comment %ld opens here",
+    "   and is still open on this line %ld */",
+    "static char *name%ld = \"a string literal %ld\";",
+    "for(int i = 0; i < %ld; i++){",
+    "  total += table[i] * %ld;",
+    "}",
+    "",
+  };
+  FILE *file = fopen(filename, "w");
+  if(file == NULL){
+    perror("Error opening file");
+    return 1;
+  }
+  for(long i = 0; i < lines; i++){
+    fprintf(file, templates[i % 8], i, i);
+    if(i + 1 < lines) fputc('\n', file);
+  }
+  if(fclose(file) != 0){
+    perror("Error writing file");
+    return 1;
+  }
+  return 0;
+}
+
+size_t repeatKeys(char *buf, size_t at, const char *keys, int times){
+  /***
+   * Write keys into buf at at times times over, returns where they end
+   */
+  size_t len = strlen(keys);
+  for(int i = 0; i < times; i++){
+    memcpy(buf + at, keys, len);
+    at += len;
+  }
+  return at;
+}
+
+void benchReplay(const char *filename, const char *name, const char *keys, size_t len, int startRow){
+  /***
+   * Feed keys to the editor one at a time as if they were typed, starting at the beginning of the row at startRow,
+   * with a frame drawn after each like the main loop does. One line of JSON with what they cost is printed. ctrl+c ends
+   * the keys early and ctrl+s is skipped so replaying keys never writes a file
+   */
+  moveCursorTo(startRow, 0, 0);
+  writeScreen();
+  feedKeys(keys, len);
+  double *times = malloc(sizeof(double) * (len + 1));
+  if(times == NULL){
+    printf("Memory allocation failed\n");
+    exit(1);
+  }
+  int lines = rowCount();
+  int numKeys = 0;
+  double total = 0;
+  long long bytes, frames, endBytes, endFrames;
+  outputTotals(&bytes, &frames);
+  long long allocs = allocations();
+  while(1){
+    double start = nowSeconds();
+    if(!replayKey()) break;
+    times[numKeys] = nowSeconds() - start;
+    total += times[numKeys++];
+  }
+  outputTotals(&endBytes, &endFrames);
+  bytes = endBytes - bytes;
+  frames = endFrames - frames;
+  if(allocs != -1) allocs = allocations() - allocs;
+  qsort(times, numKeys, sizeof(double), compareDoubles);
+  char allocsPerFrame[32] = "null"; //not counted outside the bench build
+  if(allocs != -1) snprintf(allocsPerFrame, sizeof(allocsPerFrame), "%.2f", frames > 0 ? (double)allocs / frames : 0.0);
+  printf("{\"bench\": \"%s\", \"file\": \"%s\", \"lines\": %d, \"keys\": %d, \"frames\": %lld, \"ns_per_key\": %.0f, "
+         "\"p99_ns\": %.0f, \"bytes_per_frame\": %.1f, \"allocs_per_frame\": %s}\n", name, filename, lines, numKeys,
+         frames, numKeys > 0 ? total * 1e9 / numKeys : 0.0, numKeys > 0 ? times[numKeys * 99 / 100] * 1e9 : 0.0,
+         frames > 0 ? (double)bytes / frames : 0.0, allocsPerFrame);
+  fflush(stdout);
+  free(times);
+}
+
+void benchKeys(char *filename){
+  /***
+   * Time the editor's keystroke paths on a file without a terminal: typing, enter in the middle of the file, pasting,
+   * scrolling, searching, and undoing and redoing. Each prints a line of JSON, make bench runs this on generated files
+   */
+  nmm_editor *ed = nmmOpen(filename);
+  nmmLineCount(ed); //every line should be there so the middle is the middle
+  size_t capacity = 1024 * 1024;
+  char *keys = malloc(capacity);
+  if(keys == NULL){
+    printf("Memory allocation failed\n");
+    exit(1);
+  }
+  size_t len;
+
+  len = repeatKeys(keys, 0, "the quick brown fox jumps \x7f\x7f", 25);
+  benchReplay(filename, "typing", keys, len, rowCount() / 2);
+
+  len = repeatKeys(keys, 0, "ab\r", 150);
+  benchReplay(filename, "enter", keys, len, rowCount() / 2);
+
+  len = 0;
+  for(int i = 0; i < 20; i++){ //20 pastes of 200 lines, the terminal sends their line breaks as \r
+    len = repeatKeys(keys, len, "\x1b[200~", 1);
+    len = repeatKeys(keys, len, "a pasted line with a little text on it\r", 200);
+    len = repeatKeys(keys, len, "\x1b[201~", 1);
+  }
+  benchReplay(filename, "paste", keys, len, rowCount() / 2);
+
+  len = repeatKeys(keys, 0, "\x1b[B", 1000);
+  len = repeatKeys(keys, len, "\x1b[A", 1000);
+  benchReplay(filename, "scroll", keys, len, rowCount() / 2);
+
+  len = repeatKeys(keys, 0, "\x02total\r", 1); //search as the query is typed, then go through the matches
+  len = repeatKeys(keys, len, "\x0e", 100);
+  len = repeatKeys(keys, len, "\x02", 1);
+  benchReplay(filename, "search", keys, len, rowCount() / 2);
+
+  len = repeatKeys(keys, 0, "\x1a", 300);
+  len = repeatKeys(keys, len, "\x19", 300);
+  benchReplay(filename, "undo-redo", keys, len, rowCount() / 2);
+
+  free(keys);
+  nmmClose(ed);
+}
+
+int benchRecording(char *filename, char *recording){
+  /***
+   * Time a session recorded with NOTEPADMM_RECORD on a file without a terminal, from the top of the file like the
+   * session started. Returns the exit code for main
+   */
+  size_t len;
+  char *keys = readWholeFile(recording, &len);
+  if(keys == NULL){
+    perror("Error opening recording");
+    return 1;
+  }
+  nmm_editor *ed = nmmOpen(filename);
+  benchReplay(filename, "replay", keys, len, 0);
+  free(keys);
+  nmmClose(ed);
+  return 0;
+}
+
+int main(int argc, char *argv[]){
+  if(argc == 3 && strcmp(argv[1], "--bench-load") == 0){ //time loading a file
+    benchLoad(argv[2]);
+    return 0;
+  }
+  if(argc == 3 && strcmp(argv[1], "--bench-keywords") == 0){ //time keyword matching on a file's lines
+    benchKeywords(argv[2]);
+    return 0;
+  }
+  if((argc == 4 || argc == 5) && strcmp(argv[1], "--bench-search") == 0){ //time plain and regex search over a file
+    benchSearch(argv[2], argv[3], argc == 5 ? argv[4] : NULL);
+    return 0;
+  }
+  if(argc == 4 && strcmp(argv[1], "--bench-fixture") == 0){ //write a generated file to run the benchmarks on
+    return writeFixture(atol(argv[2]), argv[3]);
+  }
+  if(argc == 3 && strcmp(argv[1], "--bench-keys") == 0){ //time the editor's keystroke paths without a terminal
+    benchKeys(argv[2]);
+    return 0;
+  }
+  if(argc == 4 && strcmp(argv[1], "--bench-replay") == 0){ //time a recorded session without a terminal
+    return benchRecording(argv[2], argv[3]);
+  }
+  fprintf(stderr, "usage: %s --bench-load FILE | --bench-keywords FILE | --bench-search FILE LITERAL [REGEX] |\n"
+                  "       --bench-fixture LINES FILE | --bench-keys FILE | --bench-replay FILE KEYS\n", argv[0]);
+  return 1;
+}
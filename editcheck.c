@@ -0,0 +1,423 @@
+/***
+ * editcheck
+ * Checks nmmApplyEdits() through the library's interface, make check runs it. Batches that are in order are made
+ * and undone in one step, and batches that are out of order, overlap, or reach outside the text are turned down
+ * without changing anything. Keys typed with nmmTypeKeys(), bracketed pastes included, are checked for the text
+ * they leave, how many undos take them back, and the buffer being marked as unsaved. Saves are checked for what
+ * ends up on disk, and for leaving nothing else behind. Buffers are checked for keeping their own text, cursor,
+ * undo steps and unsaved mark when switching between them
+ * Usage: editcheck
+ */
+
+/*** Includes ***/
+#include "libnotepadmm.h"
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*** Defines ***/
+#define MAX_TEXT 1024 //room for the whole text of the check
+#define START_TEXT "alpha beta\ngamma\ndelta epsilon" //the text every check starts from
+
+/*** Data ***/
+struct edit_case {
+  /***
+   * A batch of edits, what nmmApplyEdits() should return for it, and the text it should leave. A batch that is
+   * turned down leaves START_TEXT
+   */
+  const char *name;
+  struct nmm_edit edits[4];
+  int count;
+  int result;
+  const char *expected;
+};
+
+static const struct edit_case cases[] = {
+  {"insert and delete on one row", {{0, 0, 0, "A ", 2}, {0, 6, 4, "B", 1}}, 2, 0,
+   "A alpha B\ngamma\ndelta epsilon"},
+  {"edits on several rows", {{0, 5, 0, "!", 1}, {1, 0, 5, "GAMMA", 5}, {2, 13, 0, "?", 1}}, 3, 0,
+   "alpha! beta\nGAMMA\ndelta epsilon?"},
+  {"delete across row breaks", {{0, 5, 17, NULL, 0}}, 1, 0, "alpha epsilon"},
+  {"insert row breaks", {{0, 5, 1, "\n", 1}, {2, 5, 1, "\n\n", 2}}, 2, 0, "alpha\nbeta\ngamma\ndelta\n\nepsilon"},
+  {"adjacent edits", {{0, 0, 5, "one", 3}, {0, 5, 1, "two", 3}}, 2, 0, "onetwobeta\ngamma\ndelta epsilon"},
+  {"inserts at the same place keep their order", {{1, 0, 0, "a", 1}, {1, 0, 0, "b", 1}}, 2, 0,
+   "alpha beta\nabgamma\ndelta epsilon"},
+  {"an empty insert with no text", {{0, 0, 0, NULL, 0}}, 1, 0, START_TEXT},
+  {"rows out of order", {{1, 0, 0, "x", 1}, {0, 0, 0, "y", 1}}, 2, -1, START_TEXT},
+  {"columns out of order", {{0, 6, 0, "x", 1}, {0, 2, 0, "y", 1}}, 2, -1, START_TEXT},
+  {"overlapping deletes", {{0, 0, 5, NULL, 0}, {0, 3, 2, NULL, 0}}, 2, -1, START_TEXT},
+  {"a delete across a row break overlapping the next edit", {{0, 8, 5, NULL, 0}, {1, 1, 0, "x", 1}}, 2, -1,
+   START_TEXT},
+  {"an edit inside a delete", {{0, 0, 11, NULL, 0}, {0, 4, 0, "x", 1}}, 2, -1, START_TEXT},
+  {"a good edit before a bad one", {{0, 0, 0, "x", 1}, {9, 0, 0, "y", 1}}, 2, -1, START_TEXT},
+  {"a negative row", {{-1, 0, 0, "x", 1}}, 1, -1, START_TEXT},
+  {"a row past the end", {{3, 0, 0, "x", 1}}, 1, -1, START_TEXT},
+  {"a negative column", {{1, -1, 0, "x", 1}}, 1, -1, START_TEXT},
+  {"a column past the end of the row", {{1, 6, 0, "x", 1}}, 1, -1, START_TEXT},
+  {"a delete past the end of the text", {{2, 10, 4, NULL, 0}}, 1, -1, START_TEXT},
+  {"a negative delete length", {{0, 2, -1, "x", 1}}, 1, -1, START_TEXT},
+  {"a negative text length", {{0, 2, 0, "x", -1}}, 1, -1, START_TEXT},
+  {"text that is NULL", {{0, 2, 0, NULL, 1}}, 1, -1, START_TEXT},
+};
+
+struct key_case {
+  /***
+   * Keys typed at the start of START_TEXT, then a batch if it has any text or deletes, then more keys. The text
+   * they should leave and the text after each undo, up to the first NULL, then redo brings back expected again
+   */
+  const char *name;
+  const char *keys;
+  struct nmm_edit batch;
+  const char *more;
+  const char *expected;
+  const char *undone[4];
+};
+
+static const struct key_case keyCases[] = {
+  {"typed characters are undone in one step", "xyz", {0}, "", "xyzalpha beta\ngamma\ndelta epsilon",
+   {START_TEXT}},
+  {"moving the cursor starts a new undo step", "ab\x1b[Ccd", {0}, "", "abacdlpha beta\ngamma\ndelta epsilon",
+   {"abalpha beta\ngamma\ndelta epsilon", START_TEXT}},
+  {"backspaces are undone in one step", "\x1b[C\x1b[C\x1b[C\x7f\x7f", {0}, "", "aha beta\ngamma\ndelta epsilon",
+   {START_TEXT}},
+  {"deletes are undone in one step", "\x1b[3~\x1b[3~\x1b[3~", {0}, "", "ha beta\ngamma\ndelta epsilon",
+   {START_TEXT}},
+  {"a backspace after typing is a new undo step", "abc\x7f", {0}, "", "abalpha beta\ngamma\ndelta epsilon",
+   {"abcalpha beta\ngamma\ndelta epsilon", START_TEXT}},
+  {"a batch between keys is its own undo step", "ab", {0, 2, 0, "c", 1}, "d",
+   "abdcalpha beta\ngamma\ndelta epsilon",
+   {"abcalpha beta\ngamma\ndelta epsilon", "abalpha beta\ngamma\ndelta epsilon", START_TEXT}},
+  {"a paste over several lines is one undo step", "\x1b[200~one\rtwo\r\x1b[201~", {0}, "",
+   "one\ntwo\nalpha beta\ngamma\ndelta epsilon", {START_TEXT}},
+  {"a paste keeps tabs and drops other control characters", "\x1b[200~a\r\nb\t\x01\x7f\x1b[201~", {0}, "",
+   "a\nb\talpha beta\ngamma\ndelta epsilon", {START_TEXT}},
+  {"keys after a paste are a new undo step", "\x1b[200~ab\x1b[201~cd\x1b[D\x7f", {0}, "",
+   "abdalpha beta\ngamma\ndelta epsilon",
+   {"abcdalpha beta\ngamma\ndelta epsilon", "abalpha beta\ngamma\ndelta epsilon", START_TEXT}},
+  {"a paste after typing is a new undo step", "ab\x1b[200~cd\x1b[201~", {0}, "", "abcdalpha beta\ngamma\ndelta epsilon",
+   {"abalpha beta\ngamma\ndelta epsilon", START_TEXT}},
+};
+
+/*** Checks ***/
+int readText(nmm_editor *ed, char *text, size_t size){
+  /***
+   * Put the whole text of the editor into text with its rows joined by \n, returns -1 if it doesn't fit
+   */
+  size_t used = 0;
+  int lines = nmmLineCount(ed);
+  for(int i = 0; i < lines; i++){
+    if(i > 0) text[used++] = '\n';
+    int length = nmmGetLine(ed, i, text + used, size - used);
+    if(length < 0 || used + length + 1 >= size) return -1;
+    used += length;
+  }
+  text[used] = '\0';
+  return 0;
+}
+
+int expectText(nmm_editor *ed, const char *name, const char *step, const char *expected){
+  /***
+   * Returns 1 and says what went wrong if the editor's text isn't expected
+   */
+  char text[MAX_TEXT];
+  if(readText(ed, text, sizeof(text)) == -1 || strcmp(text, expected) != 0){
+    printf("%s: the text %s is \"%s\", expected \"%s\"\n", name, step, text, expected);
+    return 1;
+  }
+  return 0;
+}
+
+int expectModified(nmm_editor *ed, const char *name, const char *step, int expected){
+  /***
+   * Returns 1 and says what went wrong if the editor isn't marked as unsaved when expected is 1, or is when it's 0
+   */
+  int modified = nmmModified(ed);
+  if(modified != expected){
+    printf("%s: nmmModified() %s is %d, expected %d\n", name, step, modified, expected);
+    return 1;
+  }
+  return 0;
+}
+
+nmm_editor* startEditor(const char *name){
+  /***
+   * Open a new editor holding START_TEXT, with the cursor at its start. Returns NULL and says so if it couldn't be
+   */
+  nmm_editor *ed = nmmOpen(NULL);
+  struct nmm_edit start = {0, 0, 0, START_TEXT, strlen(START_TEXT)};
+  if(ed == NULL || nmmApplyEdits(ed, &start, 1) != 0){
+    printf("%s: couldn't set up the editor\n", name);
+    nmmClose(ed);
+    return NULL;
+  }
+  return ed;
+}
+
+int checkCase(const struct edit_case *c){
+  /***
+   * Make the case's batch on a new editor holding START_TEXT, then undo and redo it. Returns the number of
+   * things that went wrong
+   */
+  int failed = 0;
+  nmm_editor *ed = startEditor(c->name);
+  if(ed == NULL) return 1;
+  int result = nmmApplyEdits(ed, c->edits, c->count);
+  if(result != c->result){
+    printf("%s: nmmApplyEdits() returned %d, expected %d\n", c->name, result, c->result);
+    failed++;
+  }
+  failed += expectText(ed, c->name, "after the batch", c->expected);
+  //one undo takes back the whole batch, or the setup if the batch didn't change anything
+  int changed = strcmp(c->expected, START_TEXT) != 0;
+  nmmUndo(ed);
+  failed += expectText(ed, c->name, "after one undo", changed ? START_TEXT : "");
+  nmmRedo(ed);
+  failed += expectText(ed, c->name, "after redo", c->expected);
+  nmmClose(ed);
+  return failed;
+}
+
+int checkKeys(const struct key_case *c){
+  /***
+   * Type the case's keys on a new editor holding START_TEXT, then undo them a step at a time and redo them all.
+   * Returns the number of things that went wrong
+   */
+  int failed = 0;
+  nmm_editor *ed = startEditor(c->name);
+  if(ed == NULL) return 1;
+  nmmTypeKeys(ed, c->keys, strlen(c->keys));
+  if(c->batch.text != NULL || c->batch.deleteLength > 0){
+    if(nmmApplyEdits(ed, &c->batch, 1) != 0){
+      printf("%s: nmmApplyEdits() turned down the batch\n", c->name);
+      failed++;
+    }
+  }
+  nmmTypeKeys(ed, c->more, strlen(c->more));
+  failed += expectText(ed, c->name, "after the keys", c->expected);
+  failed += expectModified(ed, c->name, "after the keys", 1);
+  int undos = 0;
+  for(; undos < 4 && c->undone[undos] != NULL; undos++){
+    char step[32];
+    snprintf(step, sizeof(step), "after %d undo%s", undos + 1, undos > 0 ? "s" : "");
+    nmmUndo(ed);
+    failed += expectText(ed, c->name, step, c->undone[undos]);
+  }
+  for(int i = 0; i < undos; i++) nmmRedo(ed);
+  failed += expectText(ed, c->name, "after redo", c->expected);
+  failed += expectModified(ed, c->name, "after redo", 1);
+  nmmClose(ed);
+  return failed;
+}
+
+int expectFile(const char *name, const char *step, const char *path, const char *expected){
+  /***
+   * Returns 1 and says what went wrong if the file at path doesn't hold expected
+   */
+  char text[MAX_TEXT];
+  size_t length = 0;
+  FILE *fp = fopen(path, "rb");
+  if(fp != NULL){
+    length = fread(text, 1, sizeof(text) - 1, fp);
+    fclose(fp);
+  }
+  text[length] = '\0';
+  if(fp == NULL || strcmp(text, expected) != 0){
+    printf("%s: %s %s is \"%s\", expected \"%s\"\n", name, path, step, fp != NULL ? text : "missing", expected);
+    return 1;
+  }
+  return 0;
+}
+
+int checkSave(void){
+  /***
+   * Save a new editor in a directory of its own: it takes the name of its first save, saving a copy elsewhere
+   * leaves it unsaved, saving through a symlink to its file replaces the file and not the link, a save that fails
+   * leaves everything as it was, and no temp files are left behind. Returns the number of things that went wrong
+   */
+  const char *name = "saving writes the text and leaves no temp files";
+  char dir[] = "/tmp/editcheck.XXXXXX";
+  if(mkdtemp(dir) == NULL){
+    printf("%s: couldn't make a directory to save in\n", name);
+    return 1;
+  }
+  char file[64], copy[64], link[64], missing[64];
+  snprintf(file, sizeof(file), "%s/file.c", dir);
+  snprintf(copy, sizeof(copy), "%s/copy.c", dir);
+  snprintf(link, sizeof(link), "%s/link.c", dir);
+  snprintf(missing, sizeof(missing), "%s/missing/file.c", dir);
+  int failed = 0;
+  nmm_editor *ed = startEditor(name);
+  if(ed == NULL) return 1;
+  if(nmmSave(ed, file) != 0){
+    printf("%s: nmmSave() of a new file failed\n", name);
+    failed++;
+  }
+  failed += expectFile(name, "after the first save", file, START_TEXT);
+  failed += expectModified(ed, name, "after the first save", 0);
+
+  nmmTypeKeys(ed, "x", 1);
+  failed += expectModified(ed, name, "after typing", 1);
+  if(nmmSave(ed, copy) != 0){
+    printf("%s: nmmSave() of a copy failed\n", name);
+    failed++;
+  }
+  failed += expectFile(name, "after saving a copy", copy, "x" START_TEXT);
+  failed += expectFile(name, "after saving a copy", file, START_TEXT);
+  failed += expectModified(ed, name, "after saving a copy", 1);
+
+  if(symlink("file.c", link) != 0 || nmmSave(ed, link) != 0){
+    printf("%s: nmmSave() through a symlink failed\n", name);
+    failed++;
+  }
+  struct stat st;
+  if(lstat(link, &st) != 0 || !S_ISLNK(st.st_mode)){
+    printf("%s: the symlink was replaced\n", name);
+    failed++;
+  }
+  failed += expectFile(name, "after saving through a symlink", file, "x" START_TEXT);
+  failed += expectModified(ed, name, "after saving through a symlink", 0);
+
+  nmmTypeKeys(ed, "y", 1);
+  if(nmmSave(ed, missing) != -1 || errno != ENOENT){
+    printf("%s: nmmSave() into a directory that doesn't exist didn't fail with ENOENT\n", name);
+    failed++;
+  }
+  failed += expectFile(name, "after a failed save", file, "x" START_TEXT);
+  failed += expectModified(ed, name, "after a failed save", 1);
+  if(nmmSave(ed, NULL) != 0){
+    printf("%s: nmmSave() to the editor's own file failed\n", name);
+    failed++;
+  }
+  failed += expectFile(name, "after saving to its own file", file, "xy" START_TEXT);
+  failed += expectModified(ed, name, "after saving to its own file", 0);
+  nmmClose(ed);
+
+  DIR *d = opendir(dir); //only file.c, copy.c and link.c should be there
+  struct dirent *entry;
+  while(d != NULL && (entry = readdir(d)) != NULL){
+    if(entry->d_name[0] == '.') continue;
+    char path[MAX_TEXT];
+    snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+    if(strcmp(entry->d_name, "file.c") != 0 && strcmp(entry->d_name, "copy.c") != 0 &&
+       strcmp(entry->d_name, "link.c") != 0){
+      printf("%s: %s was left behind\n", name, path);
+      failed++;
+    }
+    unlink(path);
+  }
+  if(d != NULL) closedir(d);
+  rmdir(dir);
+  return failed;
+}
+
+int expectSwitch(nmm_editor *ed, const char *name, int index){
+  /***
+   * Switch to the buffer at index, returns 1 and says so if it couldn't
+   */
+  if(nmmSwitchBuffer(ed, index) != 0){
+    printf("%s: nmmSwitchBuffer() to buffer %d failed\n", name, index);
+    return 1;
+  }
+  return 0;
+}
+
+int checkBuffers(void){
+  /***
+   * Open a file and a new file next to a new editor and edit, undo and save them in turns, every buffer should
+   * keep its own text, cursor, undo steps and unsaved mark. Returns the number of things that went wrong
+   */
+  const char *name = "buffers keep their own text, cursor, undo steps and unsaved mark";
+  const char *other = "other file\nline two";
+  char dir[] = "/tmp/editcheck.XXXXXX";
+  char file[64];
+  if(mkdtemp(dir) == NULL){
+    printf("%s: couldn't make a directory for the file\n", name);
+    return 1;
+  }
+  snprintf(file, sizeof(file), "%s/other.c", dir);
+  FILE *fp = fopen(file, "wb");
+  if(fp == NULL){
+    printf("%s: couldn't write %s\n", name, file);
+    rmdir(dir);
+    return 1;
+  }
+  fputs(other, fp);
+  fclose(fp);
+  int failed = 0;
+  nmm_editor *ed = startEditor(name);
+  if(ed == NULL) return 1;
+  if(nmmOpenBuffer(ed, file) != 1 || nmmOpenBuffer(ed, NULL) != 2){
+    printf("%s: nmmOpenBuffer() didn't give the buffers the next indexes\n", name);
+    failed++;
+  }
+  failed += expectText(ed, name, "of the new file", "");
+  failed += expectModified(ed, name, "of the new file", 0);
+  nmmTypeKeys(ed, "new", 3);
+
+  failed += expectSwitch(ed, name, 1);
+  failed += expectText(ed, name, "of the file", other);
+  failed += expectModified(ed, name, "of the file", 0);
+  nmmTypeKeys(ed, "x\x1b[C", 4); //the cursor ends up after the o
+
+  failed += expectSwitch(ed, name, 0);
+  failed += expectText(ed, name, "of the first buffer", START_TEXT);
+  failed += expectModified(ed, name, "of the first buffer", 1);
+  nmmTypeKeys(ed, "\x1b[Cz", 4);
+  failed += expectText(ed, name, "of the first buffer after typing", "azlpha beta\ngamma\ndelta epsilon");
+  nmmUndo(ed);
+  failed += expectText(ed, name, "of the first buffer after an undo", START_TEXT);
+
+  failed += expectSwitch(ed, name, 1);
+  nmmTypeKeys(ed, "y", 1);
+  failed += expectText(ed, name, "of the file after typing", "xoyther file\nline two");
+  failed += expectModified(ed, name, "of the file after typing", 1);
+  nmmUndo(ed);
+  nmmUndo(ed);
+  failed += expectText(ed, name, "of the file after two undos", other);
+  nmmRedo(ed);
+  if(nmmSave(ed, NULL) != 0){
+    printf("%s: nmmSave() of the file failed\n", name);
+    failed++;
+  }
+  failed += expectFile(name, "after saving its buffer", file, "xother file\nline two");
+  failed += expectModified(ed, name, "of the file after saving it", 0);
+
+  failed += expectSwitch(ed, name, 2);
+  failed += expectText(ed, name, "of the new file after switching back", "new");
+  failed += expectModified(ed, name, "of the new file after switching back", 1);
+  if(nmmSwitchBuffer(ed, 3) != -1){
+    printf("%s: nmmSwitchBuffer() to a buffer that isn't open didn't fail\n", name);
+    failed++;
+  }
+  failed += expectText(ed, name, "after switching to a buffer that isn't open", "new");
+  failed += expectSwitch(ed, name, 0);
+  nmmRedo(ed);
+  failed += expectText(ed, name, "of the first buffer after a redo", "azlpha beta\ngamma\ndelta epsilon");
+  failed += expectModified(ed, name, "of the first buffer after a redo", 1);
+  nmmClose(ed);
+  unlink(file);
+  rmdir(dir);
+  return failed;
+}
+
+int main(void){
+  int failed = 0;
+  int numCases = sizeof(cases) / sizeof(cases[0]);
+  for(int i = 0; i < numCases; i++){
+    if(checkCase(&cases[i]) > 0) failed++;
+  }
+  int numKeyCases = sizeof(keyCases) / sizeof(keyCases[0]);
+  for(int i = 0; i < numKeyCases; i++){
+    if(checkKeys(&keyCases[i]) > 0) failed++;
+  }
+  numCases += numKeyCases;
+  if(checkSave() > 0) failed++;
+  if(checkBuffers() > 0) failed++;
+  numCases += 2;
+  printf("editcheck: %d of %d cases failed\n", failed, numCases);
+  return failed > 0;
+}
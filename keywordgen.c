@@ -0,0 +1,103 @@
+/***
+ * keywordgen
+ * Turns keyword files into C source holding their perfect hashed keyword sets, the Makefile runs it so the
+ * editor's keyword tables are compiled into it instead of being read in every time it starts
+ * Usage: keywordgen ckeyword.txt cppkeyword.txt ... > keywordtables.c
+ */
+
+/*** Includes ***/
+#include "keywords.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*** Output ***/
+void printString(const char *s){
+  /***
+   * Print s as a C string literal
+   */
+  putchar('"');
+  for(; *s != '\0'; s++){
+    if(*s == '"' || *s == '\\') putchar('\\');
+    putchar(*s);
+  }
+  putchar('"');
+}
+
+void printStrings(const char *name, const char *const *strings, int count){
+  /***
+   * Print an array of string literals, an empty array gets a NULL so it is still valid C
+   */
+  printf("static const char *const %s[] = {", name);
+  for(int i = 0; i < count; i++){
+    printf(i % 8 == 0 ? "\n  " : " ");
+    printString(strings[i]);
+    if(i < count - 1) putchar(',');
+  }
+  printf(count == 0 ? "NULL};\n" : "\n};\n");
+}
+
+void printInts(const char *name, const int *ints, int count){
+  /***
+   * Print an array of ints
+   */
+  printf("static const int %s[] = {", name);
+  for(int i = 0; i < count; i++){
+    printf(i % 16 == 0 ? "\n  " : " ");
+    printf("%d", ints[i]);
+    if(i < count - 1) putchar(',');
+  }
+  printf("\n};\n");
+}
+
+int main(int argc, char *argv[]){
+  int numSets = argc - 1;
+  struct keyword_set *sets = calloc(numSets > 0 ? numSets : 1, sizeof(struct keyword_set));
+  if(sets == NULL){
+    printf("Memory allocation failed\n");
+    exit(1);
+  }
+
+  printf("/*** Generated by keywordgen from");
+  for(int i = 1; i < argc; i++) printf(" %s", argv[i]);
+  printf(", do not edit ***/\n");
+  printf("#include \"keywords.h\"\n");
+  printf("#include <stddef.h>\n");
+
+  for(int s = 0; s < numSets; s++){
+    int count;
+    char **words = readKeywordFile(argv[s + 1], &count);
+    if(words == NULL){
+      fprintf(stderr, "keywordgen: can't open %s\n", argv[s + 1]);
+      return 1;
+    }
+    if(!buildKeywordSet(words, count, &sets[s])){
+      fprintf(stderr, "keywordgen: couldn't find a perfect hash for %s\n", argv[s + 1]);
+      return 1;
+    }
+    //the name the editor asks for is the file name without its directory
+    const char *name = strrchr(argv[s + 1], '/');
+    sets[s].name = name != NULL ? name + 1 : argv[s + 1];
+
+    char arrayName[64];
+    printf("\n");
+    snprintf(arrayName, sizeof(arrayName), "set%dWords", s);
+    printStrings(arrayName, sets[s].words, sets[s].numWords);
+    snprintf(arrayName, sizeof(arrayName), "set%dSeeds", s);
+    printInts(arrayName, sets[s].seeds, sets[s].numBuckets);
+    snprintf(arrayName, sizeof(arrayName), "set%dOperators", s);
+    printStrings(arrayName, sets[s].operators, sets[s].numOperators);
+  }
+
+  printf("\nconst struct keyword_set builtinKeywordSets[] = {\n");
+  for(int s = 0; s < numSets; s++){
+    printf("  {");
+    printString(sets[s].name);
+    printf(", set%dWords, %d, set%dSeeds, %d, set%dOperators, %d, %d, %d}%s\n", s, sets[s].numWords, s, sets[s].numBuckets,
+      s, sets[s].numOperators, sets[s].minLength, sets[s].maxLength, s < numSets - 1 ? "," : "");
+  }
+  if(numSets == 0) printf("  {NULL, NULL, 0, NULL, 0, NULL, 0, 0, 0}\n");
+  printf("};\n");
+  printf("const int numBuiltinKeywordSets = %d;\n", numSets);
+  return 0;
+}
@@ -0,0 +1,191 @@
+/*** Includes ***/
+#include "keywords.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+/*** Defines ***/
+#define KEYWORDS_PER_BUCKET 2 //average bucket size, bigger buckets make the seed table smaller but slower to build
+#define MAX_SEED (1 << 24) //give up on a bucket after this many seeds
+
+/*** Keyword Sets ***/
+unsigned int hashKeyword(const char *word, int len){
+  /***
+   * FNV-1a hash of the first len characters of word
+   */
+  unsigned int hash = 2166136261u;
+  for(int i = 0; i < len; i++){
+    hash ^= (unsigned char)word[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+unsigned int mixHash(unsigned int hash, unsigned int seed){
+  /***
+   * Turn a keyword's hash into a different well mixed number for every seed, so the result can be taken
+   * modulo any table size. The keyword itself only has to be hashed once however many seeds are tried
+   */
+  hash ^= seed * 0x9e3779b9u;
+  hash ^= hash >> 16;
+  hash *= 0x85ebca6bu;
+  hash ^= hash >> 13;
+  hash *= 0xc2b2ae35u;
+  hash ^= hash >> 16;
+  return hash;
+}
+
+char** readKeywordFile(const char *filename, int *count){
+  /***
+   * Read a keyword file with one keyword on each line, returns NULL if the file can't be opened. Blank lines
+   * are skipped and the last line doesn't need to end with a newline
+   */
+  FILE *file = fopen(filename, "r");
+  if(file == NULL) return NULL;
+
+  char **words = NULL;
+  int numWords = 0;
+  int capacity = 0;
+  char *line = NULL; //pointer to hold the line read
+  size_t len = 0; //size of the buffer
+  ssize_t read; //number of characters read
+  while((read = getline(&line, &len, file)) != -1){
+    while(read > 0 && (line[read - 1] == '\n' || line[read - 1] == '\r')) line[--read] = '\0';
+    if(read == 0) continue;
+    if(numWords == capacity){
+      capacity = capacity < 64 ? 64 : capacity * 2;
+      words = realloc(words, sizeof(char *) * capacity);
+      if(words == NULL){
+        printf("Memory allocation failed\n");
+        exit(1);
+      }
+    }
+    words[numWords] = malloc(read + 1);
+    if(words[numWords] == NULL){
+      printf("Memory allocation failed\n");
+      exit(1);
+    }
+    memcpy(words[numWords++], line, read + 1);
+  }
+  free(line);
+  fclose(file);
+  *count = numWords;
+  return words;
+}
+
+int buildKeywordSet(char **words, int count, struct keyword_set *set){
+  /***
+   * Lay count keywords out for a minimal perfect hash, the set points into words so they have to outlive it.
+   * Keywords are hashed into buckets, then going from the biggest bucket to the smallest, each bucket gets the
+   * first seed that moves all of its keywords into slots no other keyword has taken yet.
+   * Returns 0 if some bucket never found a seed, which for a list of distinct keywords doesn't happen in practice
+   */
+  memset(set, 0, sizeof(*set));
+  const char **slots = malloc(sizeof(char *) * (count > 0 ? count : 1));
+  const char **operators = malloc(sizeof(char *) * (count > 0 ? count : 1));
+  char **ids = malloc(sizeof(char *) * (count > 0 ? count : 1)); //the distinct identifier keywords
+  if(slots == NULL || operators == NULL || ids == NULL){
+    printf("Memory allocation failed\n");
+    exit(1);
+  }
+  int numIds = 0;
+  set->minLength = 0;
+  for(int i = 0; i < count; i++){
+    int len = strlen(words[i]);
+    int identifier = len > 0;
+    for(int j = 0; j < len; j++){
+      if(!isWordChar(words[i][j])) identifier = 0;
+    }
+    if(len > 0 && !identifier){
+      operators[set->numOperators++] = words[i];
+      continue;
+    }
+    int listed = 0;
+    for(int j = 0; j < numIds && !listed; j++) listed = strcmp(ids[j], words[i]) == 0;
+    if(!identifier || listed) continue;
+    ids[numIds++] = words[i];
+    if(set->minLength == 0 || len < set->minLength) set->minLength = len;
+    if(len > set->maxLength) set->maxLength = len;
+  }
+
+  int numBuckets = numIds / KEYWORDS_PER_BUCKET + 1;
+  int *seeds = calloc(numBuckets, sizeof(int));
+  int *bucketOf = malloc(sizeof(int) * (numIds > 0 ? numIds : 1));
+  int *sizes = calloc(numBuckets, sizeof(int));
+  int *members = malloc(sizeof(int) * (numIds > 0 ? numIds : 1)); //the keywords of the bucket being placed
+  int *tried = malloc(sizeof(int) * (numIds > 0 ? numIds : 1)); //their slots under the seed being tried
+  unsigned int *hashes = malloc(sizeof(unsigned int) * (numIds > 0 ? numIds : 1));
+  if(seeds == NULL || bucketOf == NULL || sizes == NULL || members == NULL || tried == NULL || hashes == NULL){
+    printf("Memory allocation failed\n");
+    exit(1);
+  }
+  int maxSize = 0;
+  for(int i = 0; i < numIds; i++){
+    hashes[i] = hashKeyword(ids[i], strlen(ids[i]));
+    bucketOf[i] = mixHash(hashes[i], 0) % numBuckets;
+    sizes[bucketOf[i]]++;
+    if(sizes[bucketOf[i]] > maxSize) maxSize = sizes[bucketOf[i]];
+  }
+  for(int i = 0; i < numIds; i++) slots[i] = NULL;
+
+  int placed = 1;
+  for(int n = numBuckets * maxSize - 1; n >= 0 && placed; n--){ //every bucket of size maxSize, then maxSize - 1, and so on
+    int b = n % numBuckets;
+    if(sizes[b] != n / numBuckets + 1) continue;
+    int numMembers = 0;
+    for(int i = 0; i < numIds; i++){
+      if(bucketOf[i] == b) members[numMembers++] = i;
+    }
+    placed = 0;
+    for(int seed = 1; seed < MAX_SEED && !placed; seed++){
+      placed = 1;
+      for(int m = 0; m < numMembers && placed; m++){
+        tried[m] = mixHash(hashes[members[m]], seed) % numIds;
+        if(slots[tried[m]] != NULL) placed = 0;
+        for(int k = 0; k < m && placed; k++) placed = tried[k] != tried[m];
+      }
+      if(placed){
+        for(int m = 0; m < numMembers; m++) slots[tried[m]] = ids[members[m]];
+        seeds[b] = seed;
+      }
+    }
+  }
+  free(bucketOf);
+  free(sizes);
+  free(members);
+  free(tried);
+  free(hashes);
+  free(ids);
+
+  set->words = slots;
+  set->numWords = numIds;
+  set->seeds = seeds;
+  set->numBuckets = numBuckets;
+  set->operators = operators;
+  if(!placed){
+    freeKeywordSet(set);
+    return 0;
+  }
+  return 1;
+}
+
+void freeKeywordSet(struct keyword_set *set){
+  /***
+   * Free a set made by buildKeywordSet, the keywords themselves belong to whoever passed them in
+   */
+  free((void *)set->words);
+  free((void *)set->seeds);
+  free((void *)set->operators);
+  memset(set, 0, sizeof(*set));
+}
+
+int keywordSetContains(const struct keyword_set *set, const char *word, int len){
+  /***
+   * Check if the first len characters of word are one of the set's identifier keywords
+   */
+  if(set->numWords == 0 || len < set->minLength || len > set->maxLength) return 0;
+  unsigned int hash = hashKeyword(word, len);
+  const char *keyword = set->words[mixHash(hash, set->seeds[mixHash(hash, 0) % set->numBuckets]) % set->numWords];
+  return strncmp(keyword, word, len) == 0 && keyword[len] == '\0';
+}
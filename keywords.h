@@ -0,0 +1,45 @@
+#ifndef KEYWORDS_H
+#define KEYWORDS_H
+
+struct keyword_set {
+  /***
+   * The keywords of one language, laid out for a minimal perfect hash. A keyword is looked up by mixing its
+   * hash with seed 0 to find its bucket, then mixing it with that bucket's seed to find its slot in words.
+   * Every identifier keyword has a slot of its own and there are no empty slots, so a lookup is one hash of
+   * the keyword and one string compare. Keywords that aren't identifiers(like ->) are kept in a plain list instead
+   * 1. name - The keyword file this set was made from, like ckeyword.txt
+   * 2. words, numWords - The identifier keywords in the order the hash puts them
+   * 3. seeds, numBuckets - The seed for each bucket
+   * 4. operators, numOperators - The keywords that aren't identifiers
+   * 5. minLength, maxLength - Length of the shortest and longest identifier keyword
+   */
+  const char *name;
+  const char *const *words;
+  int numWords;
+  const int *seeds;
+  int numBuckets;
+  const char *const *operators;
+  int numOperators;
+  int minLength;
+  int maxLength;
+};
+
+static inline int isWordChar(char c){
+  /***
+   * Check if c is one of the characters identifiers are made of, inline since it runs for every character highlighted
+   */
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+unsigned int hashKeyword(const char *, int);
+unsigned int mixHash(unsigned int, unsigned int);
+char** readKeywordFile(const char *, int *);
+int buildKeywordSet(char **, int, struct keyword_set *);
+void freeKeywordSet(struct keyword_set *);
+int keywordSetContains(const struct keyword_set *, const char *, int);
+
+//the sets for the keyword files that ship with the editor, generated by keywordgen when the editor is built
+extern const struct keyword_set builtinKeywordSets[];
+extern const int numBuiltinKeywordSets;
+
+#endif
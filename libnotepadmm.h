@@ -0,0 +1,41 @@
+#ifndef LIBNOTEPADMM_H
+#define LIBNOTEPADMM_H
+/***
+ * libnotepadmm, the editing core of Notepad-- as a static library(make libnotepadmm.a). A file is opened into an
+ * editor handle, edited in batches, saved, and closed again, or handed to nmmRun() to be edited in the terminal the
+ * way ./notepadmm does it. An editor can have several files open in buffers, everything else works on the current
+ * one. Rows and columns are 0 indexed and a \n in the text of an edit is a row break.
+ * The editor's state is kept in one place inside the library, so only one editor can be open at a time: nmmOpen()
+ * returns NULL while another one is, and the other functions fail(-1) when given a handle that isn't the open one.
+ * Only the nmm* functions are visible outside the library, everything else in it is local to it
+ */
+
+typedef struct nmm_editor nmm_editor;
+
+struct nmm_edit {
+  /***
+   * One edit of a batch, deleteLength bytes at column col of row row are replaced by textLength bytes of text.
+   * Either length can be 0, so an edit can be a plain insert or a plain delete
+   */
+  int row;
+  int col;
+  int deleteLength;
+  const char *text;
+  int textLength;
+};
+
+nmm_editor* nmmOpen(const char *);
+void nmmClose(nmm_editor *);
+int nmmOpenBuffer(nmm_editor *, const char *);
+int nmmSwitchBuffer(nmm_editor *, int);
+int nmmLineCount(nmm_editor *);
+int nmmGetLine(nmm_editor *, int, char *, int);
+int nmmApplyEdits(nmm_editor *, const struct nmm_edit *, int);
+int nmmTypeKeys(nmm_editor *, const char *, int);
+int nmmUndo(nmm_editor *);
+int nmmRedo(nmm_editor *);
+int nmmSave(nmm_editor *, const char *);
+int nmmModified(nmm_editor *);
+int nmmRun(nmm_editor *);
+
+#endif
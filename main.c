@@ -0,0 +1,17 @@
+/***
+ * Notepad--
+ * Written by Ian Kinsella
+ * The terminal editor, it opens the files it's given with libnotepadmm and lets the user edit them
+ */
+
+#include "libnotepadmm.h" //the editing core
+#include <stddef.h>
+
+int main(int argc, char *argv[]){
+  nmm_editor *ed = nmmOpen(argc >= 2 ? argv[1] : NULL);
+  for(int i = 2; i < argc; i++) nmmOpenBuffer(ed, argv[i]); //ctrl+o goes between them
+  nmmSwitchBuffer(ed, 0);
+  nmmRun(ed);
+  nmmClose(ed);
+  return 0;
+}
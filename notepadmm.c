@@ -4,6 +4,9 @@
  */
 
 #include "notepadmm.h" //header file of function prototypes
+#include "libnotepadmm.h" //what the library lets other programs use
+#include "keywords.h" //keyword sets and the tables built into the editor
+#include "regexdfa.h" //the regex engine used by regex searches
 /***
  * IMPORTANT NOTES
  * The system of the array of rows is 0 indexed, however the cursor is 1 indexed,
@@ -18,38 +21,165 @@
 #include <stdio.h>
 #include <ctype.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <string.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define HAVE_X86_SIMD 1
+#endif
 
 /*** Defines  ***/
 #define CTRL_KEY(k) ((k) & 0x1f) //used to check if ctrl + some character was pressed
 #define GROW_CAPACITY(capacity) ((capacity) < 8 ? 8 : (capacity) * 2)
 #define MIN_ROW_CAPACITY 64
+#define MIN_POOL_CHUNK 1024 //smallest number of row nodes allocated at once
+#define MMAP_THRESHOLD (32L * 1024 * 1024) //files at least this big are memory mapped instead of read in
+#define INDEX_STRIDE 4096 //number of lines between the line offsets the background indexer records
+#define INDEX_RELEASE (64L * 1024 * 1024) //bytes the indexer scans before dropping them from memory again
+#define LOAD_BLOCK (16L * 1024 * 1024) //size of each read() when loading a file
+#define MIN_LOAD_CHUNK (1L * 1024 * 1024) //smallest part of a file worth giving its own loader thread
+#define MAX_LOAD_THREADS 64
+#define SCAN_BLOCK (1L * 1024 * 1024) //bytes the indexer scans for newlines at a time
+#define SEARCH_BATCH (256L * 1024) //bytes a background search counts before handing its results back
+#define SEARCH_INLINE (1L * 1024 * 1024) //searches of less text than this are done right away without a thread
+#define SEARCH_CHUNK 65536 //most nodes a background search takes a snapshot of at once
+#define SEARCH_REFRESH 50 //milliseconds between redraws while a background search is running
+#define ESCAPE_WAIT 30 //milliseconds to wait for the rest of an escape sequence before taking escape as a key of its own
+#define PASTE_WAIT 1000 //milliseconds to wait for more of a paste before taking it as ended without its end sequence
+#define READ_CHUNK (64L * 1024) //most bytes read from the terminal at a time
+#define DEFAULT_COLOR -1 //a cell with this fg or bg uses the terminal's own color
+#define MAX_SKIP_REWRITE 4 //gaps of unchanged cells this short are rewritten instead of moving the cursor
+#define MAX_STATUS 512
+#define NUM_LANGUAGES 4 //C, Java, C++, and no keywords
+#define HL_KEYWORD 1 //the styles of highlighted spans
+#define HL_COMMENT 2
+#define HL_MATCH 3
+#define KEYWORD_COLOR 26
+#define COMMENT_COLOR 22
+#define MATCH_COLOR 160 //background of search matches
+#define MIN_CMD_BUF 4096 //first allocation of the command buffer
+#define MIN_ARENA (64L * 1024) //first size of the frame arena
+#define ARENA_ALIGN 16 //everything the frame arena hands out starts on this boundary
 #define MAX_LINE_LENGTH 1000
 #define MAX_FILENAME 256
+#define MAX_STRADDLE 16 //longest needle rowContains checks across the gap without closing it
+#define UNDO_LIMIT (64L * 1024 * 1024) //most memory the undo journal takes unless NOTEPADMM_UNDO_LIMIT says otherwise
+#define UNDO_INSERT 1 //the kinds of edits in the undo journal
+#define UNDO_DELETE 2
+#define SAVE_BLOCK (8L * 1024 * 1024) //size of the blocks a save gathers the rows into before writing them
+#define SAVE_ALIGN 4096 //the save block starts on a page boundary
+#define SAVE_DIRECT (256L * 1024) //pieces of text at least this big are written from where they are instead of copied
+#define PHASE_NONE -1 //the phases of a frame the profiler times, none is between them
+#define PHASE_INPUT 0
+#define PHASE_EDIT 1
+#define PHASE_HIGHLIGHT 2
+#define PHASE_COMPOSE 3
+#define PHASE_WRITE 4
+#define FRAME_HISTORY 256 //most recent frames the p99 frame time is taken over
 
 /*** Structures ***/
 struct cmd_buf{
   /*** 
    * The Command Buffer(cbuf) will be a dynamically sized string that will be used to write
    * the entire screen in one big write command instead of having a separate write command for
-   * each row
+   * each row. It is kept between frames and only grows, so a frame usually doesn't allocate at all
   */
   char *cmds;
   int len;
+  int capacity; //bytes allocated for cmds
+  int lastBytes; //bytes sent by the last flush
+  int lastSyscalls; //write calls made by the last flush
+  long long totalBytes; //bytes sent since the editor started
+  long long totalSyscalls; //write calls made since the editor started
+  long long frames; //number of flushes since the editor started
+  int sink; //1 when there is no terminal and the output is only counted, for the headless benchmarks
 };
 
 typedef struct row {
   /***
    * This represents a row of text, it will contain the information listed below
-   * 1. char *chars - A string of the actual text of the row
+   * 1. char *chars - A gap buffer holding the actual text of the row
    * 2. int length - Length of the row
    * 3. size_t capacity - memory capacity of the erow
+   * 4. int gapStart - index of the first byte of the gap
+   * 5. int gapEnd - index of the first byte after the gap
+   * 6. unsigned int version - Bumped by every change to the text, so cached output for the row can tell it's stale
+   * 7. unsigned int snapshot - Id of the newest background search or save that may be reading chars, see rowUnshare()
+   * The text is chars[0, gapStart) followed by chars[gapEnd, capacity - 1), the last byte of chars
+   * is always the null terminator and the gap is never empty, so chars[gapStart] can always hold a
+   * null terminator as well. That makes both halves valid strings, and when the gap sits at the end
+   * of the row chars is the whole row as one ordinary string
    */
   char *chars;
   int length;
   size_t capacity;
+  int gapStart;
+  int gapEnd;
+  unsigned int version;
+  unsigned int snapshot;
 } row;
 
+typedef struct rownode {
+  /***
+   * The rows of the editor are kept in a balanced binary tree(a treap) ordered by row index, so
+   * finding, inserting, and deleting a row costs O(log n) no matter how many rows are in the file
+   * 1. row r - The row of text stored in this node
+   * 2. left, right - The rows before and after this one
+   * 3. parent - The node above this one, NULL for the root
+   * 4. priority - Random heap priority that keeps the tree balanced
+   * 5. size - Number of rows in this subtree, used to find a row by its index
+   * 6. lines - Number of rows this node stands for, more than 1 only for unloaded spans
+   * 7. spanStart, spanLen - Where an unloaded span's text is in the memory mapped file
+   * 8. commentIn - 1 if the row starts inside a multiline comment left open by the rows above it
+   * 9. matches, subtreeMatches - Number of search matches in this node's text and in its whole subtree
+   * 10. searched - The search matches was counted for, a node with an older one is waiting on a background search
+   * 11. summed - The search subtreeMatches was added up for, when a new search starts every older sum counts as 0
+   * 12. subtreeSearched, subtreeHit - The oldest search any node of this subtree was counted for, and the oldest any
+   *     node with matches was counted for, so a search can skip the subtrees it has already counted
+   * 13. born - snapshots.lastId when the node was made, a node older than a running save may be in its snapshot
+   * A node whose row has no chars is an unloaded span of lines that are still only in the memory
+   * mapped file, rowAt() turns the line it is asked for into a real row and splits the span around it
+   */
+  row r;
+  struct rownode *left;
+  struct rownode *right;
+  struct rownode *parent;
+  unsigned int priority;
+  int size;
+  int lines;
+  int commentIn;
+  int matches;
+  int subtreeMatches;
+  unsigned int searched;
+  unsigned int summed;
+  unsigned int subtreeSearched;
+  unsigned int subtreeHit;
+  unsigned int born;
+  size_t spanStart;
+  size_t spanLen;
+} rownode;
+
+struct node_pool {
+  /***
+   * Rows nodes are handed out from big chunks of memory instead of one malloc per row, deleted
+   * nodes go on a free list so the next new row can reuse them
+   */
+  rownode *freeList; //nodes that can be reused, linked through their right pointers
+  rownode *chunk; //the chunk new nodes are currently taken from
+  int chunkUsed; //number of nodes taken from chunk so far
+  int chunkSize; //number of nodes in chunk
+  void **chunks; //every chunk allocated so far so they can be freed on exit
+  int numChunks;
+};
+
 struct editor {
   /***
    * This will contain all information about the editor, listed below
@@ -60,8 +190,10 @@ struct editor {
    * 5. winsize(size of the window)
    * 6. scroll(current vertical scroll)
    * 7. sidescroll(horizontal scroll)
+   * 8. commentFrom, commentTo(the rows whose multiline comment state may be out of date)
+   * 9. changes, savedChanges(whether there are unsaved edits)
    */
-  row *rows; //dynamic arrow of rows of text
+  rownode *rows; //root of the balanced tree of rows of text
   int Cx; //cursor x position
   int Cy; //cursor y position
   int numrows; //number of rows
@@ -69,65 +201,774 @@ struct editor {
   struct winsize w; //special struct used to store information about the terminal
   int scroll; //how far down the user is scrolled
   int sidescroll; //how far right the user is scrolled
+  int commentFrom; //first row whose commentIn may be stale, INT_MAX if every row is up to date
+  int commentTo; //last row that was changed, the state has to be redone at least this far
+  long long changes; //number of row edits so far, rows added and removed count too
+  long long savedChanges; //changes when the text was last saved, the text is unsaved if they differ
+};
+
+struct line_index {
+  /***
+   * The lines of a mapped file the indexer thread has found so far. It's on the heap rather than in mapped so the
+   * buffer can be stashed and switched away from while the indexer keeps going
+   * 1. data, size - The mapping being indexed, the indexer's own copy
+   * 2. lineStarts - Byte offset of every INDEX_STRIDE'th line
+   * 3. numLineStarts - Number of offsets recorded so far
+   * 4. totalLines - Number of lines in the file, only valid once done is set
+   * 5. cancel - Set to stop the indexer early, when the file is closed before it's done
+   * The lock guards lineStarts, numLineStarts, totalLines, done, and cancel
+   */
+  char *data;
+  size_t size;
+  size_t *lineStarts;
+  int numLineStarts;
+  int capLineStarts;
+  int totalLines;
+  int done;
+  int cancel;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+};
+
+struct mapped_file {
+  /***
+   * A file opened with mmap, a background thread indexes its lines while the editor is already running
+   * 1. data, size - The mapped file
+   * 2. index - What the indexer has found, NULL once every line is in the row tree
+   * 3. synced - Number of offsets that have been turned into spans in the row tree
+   */
+  char *data;
+  size_t size;
+  struct line_index *index;
+  int synced;
+  int finished; //set once the last span has been added to the row tree
+  pthread_t indexer;
+};
+
+struct line_table {
+  /***
+   * A growable list of the offsets of the \n characters found by scanNewlines
+   */
+  size_t *offsets;
+  size_t count;
+  size_t capacity;
+};
+
+struct load_chunk {
+  /***
+   * One loader thread's share of a file that is being read in
+   * 1. buf - The whole file
+   * 2. start, end - The part of buf this thread scans for newlines
+   * 3. newlines - The offsets of the newlines found between start and end
+   * 4. nodes - The row nodes for the lines that end at those newlines
+   * 5. lineStart - Where the first of those lines starts, it can be in an earlier chunk
+   * 6. thread, threaded - The thread working on the chunk, threaded is 0 if it couldn't be started and the main
+   *    thread did the work
+   */
+  char *buf;
+  size_t start;
+  size_t end;
+  struct line_table newlines;
+  rownode *nodes;
+  size_t lineStart;
+  pthread_t thread;
+  int threaded;
+};
+
+struct keyword_match {
+  int start; //index of the keyword in the string
+  int length;
+};
+
+struct keyword_table {
+  /***
+   * The keywords of the current language ready for matching, usually one of the sets compiled into the
+   * editor, or a set built from a keyword file when NOTEPADMM_KEYWORDS points at a directory that has one
+   * 1. set - The keywords, laid out for their perfect hash
+   * 2. fileWords, numFileWords - The keywords read from a file, NULL if set is built in
+   * 3. operatorStart - 1 for every character an operator keyword starts with
+   * 4. matches, matchCapacity - Scratch space for the matches of the row being highlighted
+   */
+  struct keyword_set set;
+  char **fileWords;
+  int numFileWords;
+  unsigned char operatorStart[256];
+  struct keyword_match *matches;
+  int matchCapacity;
+};
+
+typedef struct cell {
+  /***
+   * One character on the screen, fg and bg are 256 color palette indices or DEFAULT_COLOR
+   */
+  char ch;
+  short fg;
+  short bg;
+} cell;
+
+struct screen_grid {
+  /***
+   * The screen as a grid of cells, front is what the terminal is showing and back is the frame being
+   * drawn. flushGrid only sends the cells of back that differ from front, so a frame where one
+   * character changed only writes a few bytes
+   * 1. rows, cols - Size of the grid, this includes the status bar row
+   * 2. cursorX, cursorY - Where the terminal's cursor is after the last write(0 indexed), -1 if unknown
+   * 3. fg, bg - The colors currently set on the terminal
+   */
+  cell *front;
+  cell *back;
+  int rows;
+  int cols;
+  int cursorX;
+  int cursorY;
+  short fg;
+  short bg;
+};
+
+struct hl_span {
+  /***
+   * A stretch of a row's text that gets drawn in one style, start is the first character and end is one past the last
+   */
+  int start;
+  int end;
+  int style; //one of the HL_ styles
+};
+
+struct highlighter {
+  /***
+   * Scratch space the highlighters work in, reused for every row
+   * 1. text, textCapacity - The row being highlighted as one string
+   * 2. spans, numSpans, spanCapacity - The spans found in it so far
+   */
+  char *text;
+  int textCapacity;
+  struct hl_span *spans;
+  int numSpans;
+  int spanCapacity;
+};
+
+struct frame_arena {
+  /***
+   * Scratch memory for drawing a frame. It is handed out by moving used along and all taken back at once when the
+   * next frame starts, so once it is big enough drawing a frame doesn't call malloc at all
+   * 1. base, used, capacity - The memory, how much of it has been handed out this frame, and how big it is
+   * 2. overflow - Blocks malloc'd this frame because base was full, each starts with a pointer to the next one.
+   *    They are freed when the next frame starts, and base is made big enough to hold them all from then on
+   * 3. needed - Bytes handed out this frame, base or not
+   */
+  char *base;
+  size_t used;
+  size_t capacity;
+  char *overflow;
+  size_t needed;
+};
+
+struct highlight_entry {
+  /***
+   * The cells one row was last drawn as, along with everything they were drawn from
+   */
+  row *owner; //the row this text belongs to, NULL for an empty entry
+  unsigned int version; //owner's version when the text was made
+  int sidescroll;
+  int cols;
+  int multiline; //whether the row was inside a multiline comment
+  unsigned int search; //searchStamp when the text was made, 0 if search wasn't on
+  cell *cells; //the row's visible text with its colors
+  int numCells;
+  int capacity; //cells allocated
+};
+
+struct highlight_cache {
+  /***
+   * Highlighted rows kept between frames so rows that didn't change aren't highlighted again, entries are
+   * found by hashing the row's address and a row that lands on a taken entry just replaces it
+   */
+  struct highlight_entry *entries;
+  int capacity; //always a power of 2
+  unsigned int searchStamp; //bumped whenever search is turned on or off
+  long long hits;
+  long long misses;
+};
+
+struct search_index {
+  /***
+   * The query being searched for, compiled for Boyer-Moore-Horspool or as a regex. The matches themselves aren't stored
+   * anywhere, every row node counts the matches in its own text and its subtree, so the row tree doubles as
+   * the sorted list of every match in the document. A row that changes is recounted and only the counts on
+   * the path above it change, and the k'th match or the number of matches above a row is one walk down the tree
+   * 1. length - Length of searchQuery
+   * 2. skip - How far the query can move when a byte ends the part of the text being compared
+   * 3. regex - The compiled pattern of a regex search, NULL when searchQuery is searched for as it is
+   * 4. generation - Bumped every time the query changes, nodes counted for this query have it in searched
+   * 5. narrowBase - The first generation of a run of queries that each started with the one before, like typing
+   *    "foo" one letter at a time. Every match of a query is also a match of the queries before it, so a node
+   *    counted since narrowBase that had no matches doesn't need to be counted again
+   * 6. uncounted - Set when spans were added to the rows without being counted, they get a background search
+   */
+  int length;
+  int skip[256];
+  struct regex *regex;
+  unsigned int generation;
+  unsigned int narrowBase;
+  int uncounted;
+};
+
+struct search_piece {
+  /***
+   * A node of the row tree as it was when a background search started, with what the worker needs to read its
+   * text and what the main thread needs to tell if the node still holds that text when the count comes back
+   */
+  rownode *node;
+  const char *chars; //the row's gap buffer, or the span's text in the mapped file
+  int gapStart; //the gap of a row, a span has none
+  int gapEnd;
+  size_t length;
+  int lines;
+  int row; //index of the node's first row
+  unsigned int version;
+  int count; //matches found by the worker
+};
+
+struct search_job {
+  /***
+   * A search of the rows running on a worker thread, so searching a huge file doesn't freeze the editor. The
+   * worker counts the matches of a snapshot of the nodes in order and hands the counts back in batches, which
+   * the main thread puts into the row tree as they come. A row of the snapshot copies its text before it changes,
+   * the worker may still be reading the old copy so those are only freed once the worker is done
+   * The snapshot is taken SEARCH_CHUNK nodes at a time, so starting a search of millions of rows doesn't hold up
+   * the key that started it. When the worker is through a chunk the next one is taken from where it stopped
+   * 1. thread, lock - The worker and the lock guarding done and cancel
+   * 2. running - 1 from when the worker is started until it is joined
+   * 3. cancel - Set to make the worker stop at the end of its current batch
+   * 4. id - Stamped on the rows of the snapshot
+   * 5. pieces, numPieces - The snapshot, in row order
+   * 6. done - How many pieces the worker has counted
+   * 7. applied - How many of the counted pieces are in the row tree
+   * 8. resume, more - The row the next chunk starts at, and whether there is one
+   * 9. progress - The row the search has got to, for showing how far along it is
+   * 10. regex - The worker's own copy of a regex search, a compiled regex can only be used by one thread at a time
+   * 11. text - Worker scratch space for joining the two halves of a row
+   */
+  pthread_t thread;
+  pthread_mutex_t lock;
+  int running;
+  int cancel;
+  unsigned int id;
+  struct search_piece *pieces;
+  size_t numPieces;
+  size_t capacity;
+  size_t done;
+  size_t applied;
+  size_t totalBytes;
+  int resume;
+  int more; //1 if there are chunks left after this one
+  int progress;
+  struct regex *regex;
+  char *text;
+  size_t textCapacity;
+};
+
+struct match_scan {
+  /***
+   * Goes through the matches of a piece of text in order, started by startMatches and moved along by nextMatch.
+   * Only one scan can be going at a time since a regex keeps where the matches start for the last text it saw
+   */
+  const char *text;
+  size_t len;
+  size_t pos; //where the next match is looked for from
+  size_t start; //the match nextMatch just found
+  size_t end;
+  struct regex *regex; //the regex being matched, NULL for a plain search
+};
+
+struct search_prompt {
+  /***
+   * The query being typed into the status bar after ctrl+b or ctrl+r. The query so far is searched for after every
+   * key, and the cursor moves to the first match from where it was when the prompt opened. ctrl+s asks for the
+   * filename to save to in it too, that query isn't searched for
+   * 1. active - 1 while keys go to the prompt instead of the text
+   * 2. save, regex, label - Whether the prompt asks for a filename, whether the query is a regex, and the prompt in
+   *    front of it
+   * 3. query, length - What has been typed so far
+   * 4. error - What's wrong with the query if it isn't a valid regex
+   * 5. x, y, scroll, sidescroll - Where the cursor and view were when the prompt opened, escape goes back there
+   * 6. jumpPending - Set when the background search has to finish before the match to move to is known
+   */
+  int active;
+  int save;
+  int regex;
+  const char *label;
+  char query[256];
+  int length;
+  const char *error;
+  int x;
+  int y;
+  int scroll;
+  int sidescroll;
+  int jumpPending;
+};
+
+struct undo_entry {
+  /***
+   * One edit in the undo journal
+   * 1. kind - UNDO_INSERT or UNDO_DELETE
+   * 2. row, col - Where the text was inserted or deleted
+   * 3. text, length - Where the edit's text starts in the journal's text and how long it is, a \n in it is a row break
+   * 4. oneLine - 1 if the text has no \n, only those entries take in the keystrokes after them
+   * 5. backward - 1 for a run of backspaces, the characters are kept in the order they were deleted so the last comes first
+   * 6. cursorX, cursorY - Where the cursor was before the edit, undoing puts it back there
+   * 7. batch - Nonzero for the edits of one nmmApplyEdits() batch, which are undone and redone together
+   */
+  int kind;
+  int row;
+  int col;
+  size_t text;
+  int length;
+  int oneLine;
+  int backward;
+  int cursorX;
+  int cursorY;
+  int batch;
+};
+
+struct undo_journal {
+  /***
+   * Every edit made to the text in order, kept as the text inserted or deleted and where, so undoing or redoing an edit
+   * takes time in proportion to the edit and never copies the rows. The entries and their text are only ever added to
+   * at the end. Keystrokes typed or backspaced one after the other go into the same entry, so they are undone together
+   * 1. entries, numEntries - The edits, oldest first
+   * 2. current - Number of entries that are done, the ones after it were undone and can be redone until the next edit
+   * 3. text, textLength - The text of every entry one after the other
+   * 4. limit - Most bytes the journal can take, the oldest entries are dropped to stay under it
+   * 5. sealed - Set when the next edit shouldn't go into the last entry even if it follows on from it
+   * 6. dropped - Number of entries dropped because of the limit
+   * 7. scratch - Space for turning the text of a run of backspaces around
+   * 8. batch, lastBatch - The batch the entries being added belong to(0 outside of one) and the number of the last one
+   */
+  struct undo_entry *entries;
+  int numEntries;
+  int entryCapacity;
+  int current;
+  char *text;
+  size_t textLength;
+  size_t textCapacity;
+  size_t limit;
+  int sealed;
+  long long dropped;
+  char *scratch;
+  size_t scratchCapacity;
+  int batch;
+  int lastBatch;
+};
+
+struct save_writer {
+  /***
+   * A file being saved
+   * 1. fd - The temp file the text goes to
+   * 2. block, used - The text gathered so far that hasn't been written yet
+   * 3. written - Bytes handed to the file so far
+   * 4. error - errno of the first write that failed, 0 if none has
+   */
+  int fd;
+  char *block;
+  size_t used;
+  long long written;
+  int error;
+};
+
+struct save_piece {
+  /***
+   * A piece of text in a save's snapshot, a row is one piece or two if its gap is in the middle
+   */
+  const char *text;
+  size_t length;
+  int newline; //1 if a \n goes after it
+};
+
+struct save_job {
+  /***
+   * A save running on a worker thread, so saving a huge file doesn't stop the editor. The snapshot is the root of
+   * the row tree as it was when the save started, the main thread copies a node of it before changing it and the
+   * worker walks the old nodes while the rows keep being edited. Lines of a mapped file that aren't in the tree yet
+   * are written straight from the mapping
+   * 1. thread, lock - The worker and the lock guarding total, written and finished
+   * 2. running - 1 from when the worker is started until it is joined
+   * 3. id - The snapshot's id, every node born before it belongs to the snapshot, see ownRowNode()
+   * 4. root - The row tree the worker writes
+   * 5. data, tail, size - The mapped file and where the lines the indexer hadn't handed over yet start in it, tail is
+   *    size if they are all in the tree
+   * 6. pieces, numPieces - The text of the snapshot in order, the worker lists it before writing it
+   * 7. retired - The nodes of the snapshot that were copied, given back to the pool once the worker is done
+   * 8. total, written - Bytes in the snapshot and bytes the worker has written so far, total is 0 until it's listed
+   * 9. finished, error - Set by the worker when it's done, error is the errno it failed with or 0
+   * 10. fd, path, tmpname - The temp file, the file being saved to, and the temp file's name
+   * 11. filename - The name the user gave, for the status bar
+   * 12. changes - E.changes when the snapshot was taken, the buffer is saved as of that edit if it went to its file
+   * 13. ownFile, adopt - 1 if the save goes to the buffer's own file, adopt is the name the buffer takes as its file
+   *     once the save is done if it didn't have one, or NULL
+   * 14. start, end - When the save started and when the worker finished it, for the throughput
+   */
+  pthread_t thread;
+  pthread_mutex_t lock;
+  int running;
+  unsigned int id;
+  rownode *root;
+  const char *data;
+  size_t tail;
+  size_t size;
+  struct save_piece *pieces;
+  size_t numPieces;
+  size_t capacity;
+  rownode **retired;
+  int numRetired;
+  int retiredCapacity;
+  long long total;
+  long long written;
+  int finished;
+  int error;
+  int fd;
+  char *path;
+  char *tmpname;
+  char filename[MAX_FILENAME + 1];
+  long long changes;
+  int ownFile;
+  char *adopt;
+  double start;
+  double end;
+};
+
+struct input_buf {
+  /***
+   * Bytes read from the terminal that haven't been handled yet. Everything the terminal has sent is read in at once,
+   * the keys are then handled one at a time from here and an escape sequence that isn't all in yet waits here for the rest
+   * 1. data, capacity - The bytes
+   * 2. start, length - The next byte to read and where the bytes end
+   */
+  char *data;
+  size_t capacity;
+  size_t start;
+  size_t length;
+};
+
+struct event_loop {
+  /***
+   * What the main loop waits on. It waits for input, the window changing size, or a background job needing a redraw,
+   * handles every key that came in, and then draws one frame for all of them
+   * 1. resizePipe - The SIGWINCH handler writes a byte here so poll() wakes up when the window changes size
+   * 2. frameDue - Set when something changed since the last frame was drawn
+   * 3. frameInterval, lastFrame - Least seconds between frames(0 for no cap, see NOTEPADMM_FPS) and when the last one was drawn
+   * 4. lastInput - When bytes last came in, an escape that has been on its own for ESCAPE_WAIT is a key of its own
+   * 5. batches, keys - Times input was handled and the keys handled, for the exit stats
+   * 6. recordFd - Where every byte of input is copied to if NOTEPADMM_RECORD is set, so a session can be replayed with --bench-replay
+   * 7. quit - Set when ctrl+c is pressed, the main loop returns once the keys before it are handled
+   */
+  int resizePipe[2];
+  int frameDue;
+  double frameInterval;
+  double lastFrame;
+  double lastInput;
+  long long batches;
+  long long keys;
+  int recordFd;
+  int quit;
+};
+
+struct row_snapshots {
+  /***
+   * The background search and the background save both read rows on another thread. Every snapshot they take gets a
+   * new id that is stamped on its rows, and a row stamped with an id at least as new as a running job's may be being
+   * read by that job. Such a row copies its text before changing it, and the old copy is kept until no running job
+   * can be reading it anymore
+   * 1. lastId - The id of the newest snapshot
+   * 2. orphans, stamps - Text replaced while a job might still be reading it, and the snapshot id its row had
+   */
+  unsigned int lastId;
+  char **orphans;
+  unsigned int *stamps;
+  int numOrphans;
+  int orphanCapacity;
+};
+
+struct frame_span {
+  /***
+   * One phase of a frame, as written to the trace
+   * 1. phase - Which phase it was, one of the PHASE_ defines
+   * 2. start, end - When it began and ended, in seconds
+   */
+  int phase;
+  double start;
+  double end;
+};
+
+struct frame_profile {
+  /***
+   * Times how long each frame spends reading input, editing, highlighting, composing the grid and writing it to the
+   * terminal. Nothing is timed unless the frame times are shown(ctrl+t) or traced(NOTEPADMM_TRACE), so it costs
+   * nothing otherwise
+   * 1. hud - Set when the status bar shows the last and p99 frame times
+   * 2. trace, traceEvents - The Chrome trace event file every frame's phases are written to, and how many events it has
+   * 3. origin - When the editor started, the times in the trace count from here
+   * 4. phase, phaseStart - The phase being timed and when it began
+   * 5. spans - The phases timed since the last frame was drawn
+   * 6. history, numFrames - How long the last FRAME_HISTORY frames took(a ring) and how many frames were timed
+   * 7. last, p99 - How long the last frame took and the 99th percentile of history, in seconds
+   * 8. frameBytes - cbuf.totalBytes when the last frame was done, so a frame's bytes can go in the trace
+   */
+  int hud;
+  FILE *trace;
+  long long traceEvents;
+  double origin;
+  int phase;
+  double phaseStart;
+  struct frame_span *spans;
+  int numSpans;
+  int spanCapacity;
+  double history[FRAME_HISTORY];
+  long long numFrames;
+  double last;
+  double p99;
+  long long frameBytes;
+};
+
+struct buffer {
+  /***
+   * A file open in the editor. The buffer being edited keeps its state in the globals and the others keep theirs
+   * here, so switching buffers only copies these back and forth
+   * 1. e - Its rows, cursor, scroll and unsaved changes, the window size and terminal settings in it aren't its own
+   * 2. pool, mapped - The pool its row nodes come from and its memory mapped file
+   * 3. hlCache, journal - Its highlighted rows and its undo history
+   * 4. filename - The name it is saved under, NULL for a new file that doesn't have one yet
+   * 5. keywords - The keyword table it's highlighted with, shared with every other buffer of the same language
+   * 6. saveJob, snapshots - Its background save and the row text the save may still be reading, a save keeps
+   *    running while the buffer is stashed
+   */
+  struct editor e;
+  struct node_pool pool;
+  struct mapped_file mapped;
+  struct highlight_cache hlCache;
+  struct undo_journal journal;
+  char *filename;
+  struct keyword_table *keywords;
+  struct save_job *saveJob;
+  struct row_snapshots snapshots;
+};
+
+struct buffer_list {
+  /***
+   * The files open in the editor, ctrl+o goes through them in order
+   * 1. buffers, numBuffers - The buffers in the order they were opened, the current one's entry is stale until it's stashed
+   * 2. current - Index of the buffer being edited
+   */
+  struct buffer *buffers;
+  int numBuffers;
+  int capacity;
+  int current;
 };
 
 /*** Global Variables ***/
 struct editor E; //The global editor struct
 struct cmd_buf cbuf; //The global command buffer
+struct node_pool pool; //The pool row nodes are allocated from
+struct mapped_file mapped; //The memory mapped file, data is NULL if the file was read in normally
+struct screen_grid grid; //The front and back screen buffers
+struct highlight_cache hlCache; //Highlighted rows from the last frames
+struct highlighter hl; //Scratch space for highlighting a row
+struct frame_arena arena; //Scratch memory for the frame being drawn
+struct keyword_table languages[NUM_LANGUAGES]; //The keywords of every language, loaded when a file of it is first opened
+int languagesLoaded; //Bit i is set once languages[i] is loaded
+struct keyword_table *keywords; //The keywords of the current buffer's language, one of languages
+struct buffer_list buffers; //The files open in the editor
+struct search_index search; //The compiled search query
+struct search_job searchJob = {.lock = PTHREAD_MUTEX_INITIALIZER}; //The background search, if one is running
+struct save_job *saveJob; //The current buffer's background save, every buffer has its own
+struct row_snapshots snapshots; //Row text the current buffer's background jobs may still be reading
+struct input_buf input; //Keys read ahead of time
+struct event_loop loop; //What the main loop is waiting on
+struct frame_profile prof; //How long the phases of the frames took
+char statusMessage[MAX_STATUS]; //The message shown in the status bar
 char *CURRENT_FILENAME; //The name of the current file open
 int searchFlag; //Toggled if user is currently using the search feature
 char searchQuery[256]; //The query the user searched for
-char **keywords; //Array of strings of keywords to highlight
-int numKeywords; //Number of keywords in the language
+struct search_prompt prompt; //The search being typed, if the prompt is open
+struct undo_journal journal; //The edits that can be undone and redone
 
 /*** Function Prototypes ***/
 //note for these prototypes I didn't want to include them in the header file because
 //they take one of the structs I've defined as parameters so I just didn't want to bother
 //with defining the struct in the header file
-void shiftLineCharsR(int index, row *row);
-void shiftLineCharsL(int index, row *row);
 void initializeRowMemory(row *r, size_t capacity);
 row duplicate_row(row *original_row);
 void setChars(row *row, char *chars, int strlen);
+row* rowAt(int index);
+int applyEdits(const struct nmm_edit *edits, int count, int *endRow, int *endCol);
+row* insertRowAt(int index);
+void deleteRowAt(int index);
+rownode* rowNodeAt(int index);
+rownode* nextRowNode(rownode *node);
+rownode* loadSpanRow(rownode *node, int index, int offset);
+int nodeShared(rownode *node);
+rownode* copyRowNode(rownode *node);
+rownode* ownRowNode(rownode *node);
+void addSavePiece(struct save_job *job, const char *text, size_t length, int newline);
+void listSaveRows(struct save_job *job, rownode *node);
+void insertNodeAt(int index, rownode *node);
+int lexComment(row *r, int in, int *opened);
+void updateNode(rownode *node);
+int openMappedFile(char *filename, struct stat *st);
+int loadFileBlocks(char *filename);
+void scanNewlines(const char *buf, size_t len, size_t base, struct line_table *table);
+void* indexMappedFile(void *arg);
+void syncMappedRows(void);
+void syncMappedRowsTo(int index);
+void finishMappedFile(void);
+void endIndexer(void);
+void rowMoveGap(row *r, int index);
+void rowGrowGap(row *r, int needed);
+char* rowChars(row *r);
+char rowCharAt(row *r, int index);
+void rowInsertChar(row *r, int index, char c);
+void rowDeleteChar(row *r, int index);
+void rowTruncate(row *r, int index);
+void rowAppend(row *r, char *chars, int len);
+void rowInsert(row *r, int index, const char *chars, int len);
+void rowDelete(row *r, int index, int len);
+void rowCopy(row *r, int index, int len, char *out);
+struct undo_entry* addUndoEntry(int kind, int index, int col, const char *text, int len);
+struct undo_entry* lastUndoEntry(void);
+char* undoText(struct undo_entry *entry);
+void saveBytes(struct save_writer *w, const char *data, size_t len);
+void flushSave(struct save_writer *w, const char *data, size_t len);
+int rowShared(row *r);
+int rowContains(row *r, char *needle);
+cell* highlightRow(row *r, int multiline, int *numCells);
+char* highlightText(row *r);
+void emitSpans(cell *cells, char *text, int from, int count);
+void loadKeywords(struct keyword_table *table, const char *name);
+struct keyword_table* languageFor(char *filename);
+void stashBuffer(struct buffer *b);
+void restoreBuffer(struct buffer *b);
+void freeKeywordTable(struct keyword_table *table);
+void addKeywordMatch(struct keyword_table *table, int count, int start, int length);
+int matchKeywords(struct keyword_table *table, char *chars, int limit);
+void searchRow(rownode *node);
+void countNode(rownode *node);
+int nodeCounted(rownode *node);
+int subtreeCounted(rownode *node);
+int collectPieces(rownode *node, int first);
+int ownMatches(rownode *node);
+int pieceIsCurrent(struct search_piece *piece);
+void sumMarked(rownode *node);
+int countMatches(struct regex *regex, const char *text, size_t len);
+void rowUnshare(row *r);
+void rowFreeChars(row *r);
+rownode* findMatchNode(int k, int *index, int *rank);
+int matchesBeforeColumn(row *r, int col);
+char* searchRowText(row *r);
+void startMatches(struct match_scan *scan, struct regex *regex, const char *text, size_t len);
+int nextMatch(struct match_scan *scan);
 
 /*** Command Buffer ***/
-void add_cmd(char *cmd, int last_cmd){
+void add_bytes(char *bytes, int len){
   /***
-   * Used to add a command to the global command buffer(cbuf)
+   * Used to add len bytes to the global command buffer(cbuf), growing it to at least twice its size when it's full
    */
-  if(cmd != NULL){
-    int cmd_len = snprintf(NULL, 0, "%s", cmd);
-    if(last_cmd) cmd_len++;
-    cbuf.len += cmd_len;
-    cbuf.cmds = realloc(cbuf.cmds, cbuf.len); //reallocate cmds to make space for the new command
+  if(cbuf.len + len > cbuf.capacity){
+    int capacity = cbuf.capacity > 0 ? cbuf.capacity * 2 : MIN_CMD_BUF;
+    while(capacity < cbuf.len + len) capacity *= 2;
+    cbuf.cmds = realloc(cbuf.cmds, capacity); //reallocate cmds to make space for the new command
     if(cbuf.cmds == NULL){ //check if realloc was successful
       printf("Memory allocation failed\n");
-      return;
-    }
-    if(last_cmd){
-      memcpy(cbuf.cmds + cbuf.len - cmd_len, cmd, cmd_len-1);
-    }else{
-      memcpy(cbuf.cmds + cbuf.len - cmd_len, cmd, cmd_len); 
+      exit(1);
     }
+    cbuf.capacity = capacity;
+  }
+  memcpy(cbuf.cmds + cbuf.len, bytes, len);
+  cbuf.len += len;
+}
+
+void add_cmd(char *cmd, int last_cmd){
+  /***
+   * Used to add a command to the global command buffer(cbuf), the last command of a buffer also adds its null terminator
+   */
+  if(cmd != NULL){
+    add_bytes(cmd, strlen(cmd) + (last_cmd ? 1 : 0));
   }
 }
 
 void writeCmds(void){
   /***
-   * Writes all the commands in cbuf to STDOUT
+   * Writes all the commands in cbuf to STDOUT, this is the only place screen output is sent from so
+   * each frame costs a single write unless the terminal takes it in pieces
    */
-  write(STDOUT_FILENO, cbuf.cmds, cbuf.len);
-  cbuf.len = 0; //set len back to 0
-  free(cbuf.cmds);
-  cbuf.cmds = NULL; //set cmds back to NULL
+  int sent = 0;
+  cbuf.lastSyscalls = 0;
+  if(cbuf.sink) sent = cbuf.len; //measured as if it had been sent
+  while(sent < cbuf.len){
+    ssize_t n = write(STDOUT_FILENO, cbuf.cmds + sent, cbuf.len - sent);
+    cbuf.lastSyscalls++;
+    if(n == -1){
+      if(errno == EINTR || errno == EAGAIN) continue;
+      break; //the terminal is gone, nothing more can be shown
+    }
+    sent += n;
+  }
+  cbuf.lastBytes = sent;
+  cbuf.totalBytes += sent;
+  cbuf.totalSyscalls += cbuf.lastSyscalls;
+  cbuf.frames++;
+  cbuf.len = 0; //set len back to 0, the memory is kept for the next frame
+}
+
+void printOutputStats(void){
+  /***
+   * Print how much was sent to the terminal over the whole session, shown on exit when NOTEPADMM_STATS is set
+   */
+  if(getenv("NOTEPADMM_STATS") == NULL || cbuf.frames == 0) return;
+  fprintf(stderr, "output: %lld frames, %lld bytes, %lld write calls, %.1f bytes/frame, %.2f writes/frame\n",
+    cbuf.frames, cbuf.totalBytes, cbuf.totalSyscalls,
+    (double)cbuf.totalBytes / cbuf.frames, (double)cbuf.totalSyscalls / cbuf.frames);
+  fprintf(stderr, "input: %lld keys in %lld batches, %.2f keys/frame\n", loop.keys, loop.batches, (double)loop.keys / cbuf.frames);
+  fprintf(stderr, "highlighting: %lld rows reused, %lld rows highlighted\n", hlCache.hits, hlCache.misses);
+  fprintf(stderr, "undo journal: %d entries, %zu bytes of %zu allowed, %lld entries dropped\n",
+    journal.numEntries, journalBytes(), journal.limit, journal.dropped);
+}
+
+void outputTotals(long long *bytes, long long *frames){
+  /***
+   * Set bytes and frames to how much has been sent to the terminal(or counted, without one) since the editor started
+   */
+  *bytes = cbuf.totalBytes;
+  *frames = cbuf.frames;
 }
 
 /*** Editor Initialization and Program Exit***/
 void getWinSize(void){
   /***
-   * Gets the window size
+   * Gets the window size, without a terminal(like in the headless benchmarks) the window is 80x24
+   */
+  if(cbuf.sink || ioctl(0, TIOCGWINSZ, &E.w) == -1 || E.w.ws_col == 0){
+    E.w.ws_row = 24;
+    E.w.ws_col = 80;
+  }
+}
+
+void resizeEditor(void){
+  /***
+   * Fit the editor to the window's new size, the grid is made again and the next frame is drawn from scratch
    */
-    ioctl(0, TIOCGWINSZ, &E.w);
+  getWinSize();
+  E.w.ws_row--; //leave room for the status message bar
+  if(E.w.ws_row < 1) E.w.ws_row = 1;
+  if(E.w.ws_col < 1) E.w.ws_col = 1;
+  free(grid.front);
+  free(grid.back);
+  initGrid();
+  clearHighlightCache();
+  free(hlCache.entries);
+  initHighlightCache();
+  if(E.Cy - E.scroll > E.w.ws_row) E.scroll = E.Cy - E.w.ws_row; //keep the cursor on the screen
+  if(E.Cx - E.sidescroll > E.w.ws_col) E.sidescroll = E.Cx - E.w.ws_col;
+  loop.frameDue = 1;
 }
 
 void enableRawMode(void){
@@ -137,8 +978,10 @@ void enableRawMode(void){
   tcgetattr(STDIN_FILENO, &E.termios_o);
   struct termios termios_r = E.termios_o;
 
-  atexit(exitRawMode);
-  
+  static int registered = 0; //nmmRun can enable raw mode many times, the terminal only has to be put back once at exit
+  if(!registered) atexit(exitRawMode);
+  registered = 1;
+
   termios_r.c_iflag &= ~(IGNBRK | BRKINT | PARMRK | ISTRIP
                   | INLCR | IGNCR | ICRNL | IXON);
   termios_r.c_oflag &= ~OPOST;
@@ -146,1108 +989,4046 @@ void enableRawMode(void){
   termios_r.c_cflag &= ~(CSIZE | PARENB);
   termios_r.c_cflag |= CS8;
   tcsetattr(STDIN_FILENO, TCSAFLUSH, &termios_r);
+  write(STDOUT_FILENO, "\x1b[?2004h", 8); //turn on bracketed paste, a paste comes between \x1b[200~ and \x1b[201~
 }
 
 void exitRawMode(void){
   /***
    * Disables raw mode
    */
+  write(STDOUT_FILENO, "\x1b[?2004l", 8); //turn bracketed paste back off
   tcsetattr(STDIN_FILENO, TCSAFLUSH, &E.termios_o);
 }
 
-void initEditor(char *filename){
+void initScreen(void){
   /***
-   * Initialize the global editor object's fields, add the first empty row, get the window size,
-   * and determine the language of the file open to adjust syntax highlighting
+   * Get the window size and set up the command buffer and the screen grid, everything the buffers share
    */
-  E.rows = NULL; //initialize rows to null as no text is present yet
-  E.numrows = 0;
-  appendRow(); //we create the first row, it has no chars, E.numrows doesn't need to be initialized anymore
-  E.Cx = 1; //initialize cursor position to (1,1) which is the top left of the screen
-  E.Cy = 1;
-  E.scroll = 0; //scrolled to top of terminal to begin with
-  E.sidescroll = 0; //scrolled to far left of terminal to begin with
-
   //we don't have to initialize termios_o as enableRawMode takes care of setting its attributes
   getWinSize(); //this call to get winsize takes cares of initializing winsize w to have the correct values
   E.w.ws_row--; //we decrement row by 1 to leave room for the status message bar
 
-  write(STDOUT_FILENO, "\x1b[2J", 4); //clear the screen
-  write(STDOUT_FILENO, "\x1b[H", 3); //actually move the cursor to the top left of the screen
-
-  cbuf.cmds = NULL; //initialize the command buffers commands to "" and length to 0
-  cbuf.len = 0; //1 for the null terminator
+  int sink = cbuf.sink; //set before this by the headless benchmarks
+  memset(&cbuf, 0, sizeof(cbuf)); //the command buffer starts empty and allocates on its first command
+  cbuf.sink = sink;
 
-  CURRENT_FILENAME = NULL; //set CURRENT_FILENAME to null to handle the case the user doesn't open a file
+  initGrid(); //set up the screen buffers and clear the screen
+  statusMessage[0] = '\0';
   searchFlag = 0; //set serachFlag initiallly to 0 since we won't be searching on initialization
-  if(filename[strlen(filename) - 1] == 'c'){
-    keywords = readTextArray("ckeyword.txt");
-  } else if (filename[strlen(filename) - 2] == 'v' && filename[strlen(filename) - 1] == 'a'){
-    keywords = readTextArray("javakeyword.txt");
-  } else if(filename[strlen(filename) - 2] == 'p' && filename[strlen(filename) - 1] == 'p'){
-    keywords = readTextArray("cppkeyword.txt");
-  } else{
-    keywords = NULL;
-    numKeywords = 0;
+  initProfile();
+}
+
+void initBuffer(char *filename){
+  /***
+   * Start a new empty buffer in the globals, with the first empty row, the cursor at the top left and an empty undo
+   * journal. The language of the file is worked out from filename to adjust syntax highlighting. Whatever buffer
+   * was in the globals has to have been stashed or freed first
+   */
+  struct winsize w = E.w; //the window and the terminal belong to every buffer
+  struct termios termios_o = E.termios_o;
+  memset(&E, 0, sizeof(E));
+  E.w = w;
+  E.termios_o = termios_o;
+  memset(&pool, 0, sizeof(pool)); //the node pool starts out empty
+  memset(&mapped, 0, sizeof(mapped));
+  memset(&snapshots, 0, sizeof(snapshots));
+  saveJob = calloc(1, sizeof(struct save_job));
+  if(saveJob == NULL){
+    printf("Memory allocation failed\n");
+    exit(1);
   }
+  pthread_mutex_init(&saveJob->lock, NULL);
+  appendRow(); //we create the first row, it has no chars, E.numrows doesn't need to be initialized anymore
+  E.savedChanges = E.changes; //an empty buffer has nothing unsaved
+  E.Cx = 1; //initialize cursor position to (1,1) which is the top left of the screen
+  E.Cy = 1;
+  E.scroll = 0; //scrolled to top of terminal to begin with
+  E.sidescroll = 0; //scrolled to far left of terminal to begin with
+  E.commentFrom = 0; //the first row still needs its multiline comment state worked out
+  E.commentTo = 0;
+
+  initHighlightCache();
+  initJournal();
+  CURRENT_FILENAME = NULL; //set CURRENT_FILENAME to null to handle the case the user doesn't open a file
+  keywords = languageFor(filename);
 }
 
 void free_all_rows(void){
   /***
-   * Free all rows of text in the global editor object E as well as the array of keywords
+   * Free all rows of text in the global editor object E, the keyword tables are shared by the buffers and stay
    */
-  for(int i = 0; i < E.numrows; i++){
-    free(E.rows[i].chars);
-    E.rows[i].chars = NULL;
+  stopSearchJob(); //the workers may be reading the rows
+  waitForSave();
+  for(rownode *node = rowNodeAt(0); node != NULL; node = nextRowNode(node)){
+    free(node->r.chars);
+    node->r.chars = NULL;
   }
-  for(int i = 0; i < numKeywords; i++){
-    free(keywords[i]);
-    keywords[i] = NULL;
+  for(int i = 0; i < pool.numChunks; i++){ //the nodes themselves all live in the pool's chunks
+    free(pool.chunks[i]);
   }
-  free(E.rows);
-  free(keywords);
+  free(pool.chunks);
+  memset(&pool, 0, sizeof(pool));
   E.rows = NULL;
+  E.numrows = 0;
+  clearHighlightCache(); //the cached rows point at nodes that are gone now
+  if(mapped.data != NULL){
+    if(!mapped.finished){ //the indexer may still be reading the mapping
+      pthread_mutex_lock(&mapped.index->lock);
+      mapped.index->cancel = 1;
+      pthread_mutex_unlock(&mapped.index->lock);
+      endIndexer();
+    }
+    munmap(mapped.data, mapped.size);
+    mapped.data = NULL;
+  }
 }
 
-/*** Row Manipulation Methods ***/
-char* sideScrollCharSet(row *row){
+/*** Buffers ***/
+struct keyword_table* languageFor(char *filename){
   /***
-   * Returns the string(adjusted for sidescroll and window size) that is to be printed to the screen
+   * Returns the keyword table for the language of a file called filename. Each language's table is only loaded the
+   * first time a file of it is opened, every buffer of that language shares it after that
    */
-  int offset = 0;
-  if((row->length - E.sidescroll) >= E.w.ws_col){
-    char *substr;
-    substr = malloc(E.w.ws_col + offset + 1); //+1 for null terminator
-    strncpy(substr, row->chars + E.sidescroll - offset, E.w.ws_col + offset); //copy chars over to substr
-    substr[E.w.ws_col + offset] = '\0'; //ensure substr is null termirnated
-    return substr;
-  } else if(E.sidescroll <= row->length){
-    char *substr;
-    substr = malloc(row->length - E.sidescroll - offset + 1); //+1 for null terminator
-    strncpy(substr, row->chars + E.sidescroll + offset, (row->length - E.sidescroll) - offset);
-    substr[row->length - E.sidescroll - offset] = '\0'; //ensure substr is null termirnated
-    return substr;
-  } else if(E.sidescroll > row->length){
-    return NULL;
+  static const char *names[NUM_LANGUAGES] = {"ckeyword.txt", "javakeyword.txt", "cppkeyword.txt", NULL};
+  int len = strlen(filename);
+  int language = 3; //no keywords to highlight
+  if(len >= 1 && filename[len - 1] == 'c'){
+    language = 0;
+  } else if(len >= 2 && filename[len - 2] == 'v' && filename[len - 1] == 'a'){
+    language = 1;
+  } else if(len >= 2 && filename[len - 2] == 'p' && filename[len - 1] == 'p'){
+    language = 2;
   }
-  return NULL;
+  if(!(languagesLoaded & (1 << language))){
+    loadKeywords(&languages[language], names[language]);
+    languagesLoaded |= 1 << language;
+  }
+  return &languages[language];
 }
 
-void setChars(row *row, char *chars, int strlen){
+void freeLanguages(void){
   /***
-   * Sets the characters of row to chars
+   * Free every keyword table that was loaded
    */
-  if(row->capacity <= (size_t)strlen){//reallocate row's capacity if needed
-    row->chars = realloc(row->chars, (size_t)(strlen+1)); //+1 for null terminator
-    row->capacity = strlen + 1;
+  for(int i = 0; i < NUM_LANGUAGES; i++){
+    if(languagesLoaded & (1 << i)) freeKeywordTable(&languages[i]);
   }
+  languagesLoaded = 0;
+  keywords = NULL;
+}
 
-  free(row->chars); //free row's chars before reassignment
-
-  char *new_chars = malloc(row->capacity); //make a new_chars to copy chars to row
-  memcpy(new_chars, chars, strlen + 1);//+1 for null terminator
-  row->chars = new_chars;
-
-  row->length = strlen;
-  row->chars[strlen] = '\0'; //make sure chars is null terminated
-} 
-
-row duplicate_row(row *original) {
+void stashBuffer(struct buffer *b){
   /***
-   * Creates a duplicate row of original
+   * Move the current buffer out of the globals into b. The indexer of a mapped file and a running save keep going,
+   * they only use state on the heap that moves along with the buffer. A search belongs to the buffer it was started
+   * in, so it's turned off
    */
-
-  // Initialize a new row
-  row new_row;
-
-  new_row.chars = malloc(original->capacity * sizeof(char));
-  if (new_row.chars == NULL) {
-      // Handle memory allocation failure
-      new_row.length = 0;
-      new_row.capacity = 0;
-      return new_row;
+  if(searchFlag){
+    searchFlag = 0;
+    hlCache.searchStamp++;
+    statusMessage[0] = '\0';
   }
-
-  //copy original's chars to new_row's chars
-  memcpy(new_row.chars, original->chars, original->length + 1);//+1 for null terminator
-
-  //ensure new_row chars is null terminated
-  new_row.chars[original->length] = '\0';
-
-  // Copy other properties
-  new_row.length = original->length;
-  new_row.capacity = original->capacity;
-  return new_row;
+  stopSearchJob();
+  b->e = E;
+  b->pool = pool;
+  b->mapped = mapped;
+  b->hlCache = hlCache;
+  b->journal = journal;
+  b->filename = CURRENT_FILENAME;
+  b->keywords = keywords;
+  b->saveJob = saveJob;
+  b->snapshots = snapshots;
 }
 
-void initializeRowMemory(row *r, size_t capacity) {
+void restoreBuffer(struct buffer *b){
   /***
-   * Allocates memory for a newly created row and initializes its fields
+   * Make b the buffer in the globals, it keeps the current window size and terminal settings
    */
-  //initialize chars to have MIN_ROW_CAPACITY bytes
-  r->chars = malloc(capacity);
-  r->capacity = MIN_ROW_CAPACITY;
-  if (r->chars == NULL) {
-      // Handle memory allocation failure
-      exit(1);
-  }
-  //set chars equal to all 0(the null terminator)
-  memset(r->chars, 0, capacity);
-  //ensure the first character of chars is null terminator and set length to 0
-  r->chars[0] = '\0';
-  r->length = 0;
+  struct winsize w = E.w;
+  struct termios termios_o = E.termios_o;
+  E = b->e;
+  E.w = w;
+  E.termios_o = termios_o;
+  pool = b->pool;
+  mapped = b->mapped;
+  hlCache = b->hlCache;
+  journal = b->journal;
+  CURRENT_FILENAME = b->filename;
+  keywords = b->keywords;
+  saveJob = b->saveJob;
+  snapshots = b->snapshots;
 }
 
-void appendRow(void) {
+int openBuffer(const char *filename){
   /***
-   * Adds a new unitialized row to the global editor object's array of rows
+   * Open filename in a new buffer and switch to it, a file that doesn't exist yet starts out empty and a NULL
+   * filename is a new file that gets a name when it's saved. Returns the new buffer's index
    */
-  
-  //increate numrows and allocate memory for the new row
-  E.numrows++;
-  E.rows = realloc(E.rows, sizeof(row) * E.numrows);
-  if (E.rows == NULL) {
-      // Handle memory allocation failure
+  if(buffers.numBuffers > 0) stashBuffer(&buffers.buffers[buffers.current]);
+  if(buffers.numBuffers == buffers.capacity){
+    buffers.capacity = GROW_CAPACITY(buffers.capacity);
+    buffers.buffers = realloc(buffers.buffers, sizeof(struct buffer) * buffers.capacity);
+    if(buffers.buffers == NULL){
+      printf("Memory allocation failed\n");
       exit(1);
+    }
   }
-  //initialize the memory of the newly created row
-  initializeRowMemory(&E.rows[E.numrows - 1], MIN_ROW_CAPACITY);
-}
-
-void deleteExistingRow(void){
-  /***
-   * Delete a row
-   */
-  if(E.rows[E.numrows-1].chars != NULL) free(E.rows[E.numrows-1].chars); //free the chars of the bottom row
-  E.numrows--; //decrement number of rows
-  if (E.rows == NULL) { //check if reallocation was successful
+  char *name = filename != NULL ? strdup(filename) : NULL; //the buffer's own copy, CURRENT_FILENAME points at it
+  if(filename != NULL && name == NULL){
     printf("Memory allocation failed\n");
     exit(1);
   }
+  initBuffer(name != NULL ? name : "hello_world.c"); //a new file is highlighted as C
+  struct stat st;
+  if(name != NULL && stat(name, &st) == 0){
+    readFile(name);
+  } else {
+    CURRENT_FILENAME = name; //saved under its name the first time
+  }
+  buffers.current = buffers.numBuffers++;
+  return buffers.current;
 }
 
-void shiftRowsDown(int index){
+void switchBuffer(int index){
   /***
-   * Shift all rows up to index down 1
+   * Stash the current buffer and bring back the buffer at index. Nothing is read or highlighted again, the next
+   * frame only draws what differs between the two
    */
-  free(E.rows[E.numrows-1].chars);
-  for(int i = E.numrows - 1; i > index + 1; i--){
-    E.rows[i] = E.rows[i-1];
-  }
-
-  row dup_row = duplicate_row(&E.rows[index]);
-
-  E.rows[index+1] = dup_row;
+  if(index == buffers.current || index < 0 || index >= buffers.numBuffers) return;
+  stashBuffer(&buffers.buffers[buffers.current]);
+  restoreBuffer(&buffers.buffers[index]);
+  buffers.current = index;
+  snprintf(statusMessage, sizeof(statusMessage), "%s (%d of %d)", CURRENT_FILENAME != NULL ? CURRENT_FILENAME :
+           "New file", index + 1, buffers.numBuffers);
 }
 
-void shiftRowsUp(int index){
+void nextBuffer(void){
   /***
-   * Shift all rows down from index up 1
+   * Switch to the buffer after the current one, from the last back to the first
    */
-  if(index < E.numrows-1) free(E.rows[index].chars);
-  for(int i = index; i < E.numrows - 1; i++){
-    E.rows[i] = E.rows[i+1];
-  }
-
-  int lowrow = E.numrows - 1;
-
-  if((E.numrows - index) > 1){
-    row dup_row = duplicate_row(&E.rows[lowrow]);
-    E.rows[lowrow-1] = dup_row;
+  if(buffers.numBuffers < 2){
+    snprintf(statusMessage, sizeof(statusMessage), "No other files are open"); //shown with the next frame
+    return;
   }
-
+  switchBuffer((buffers.current + 1) % buffers.numBuffers);
 }
 
-void addRow(void){
+void freeBuffer(void){
   /***
-   * Create a new row in the text editor in response to the user pressing enter, this method handles splitting a row and copying
-   * its characters if the user presses enter in the middle of a row
+   * Free the buffer in the globals
    */
-  int cy = E.Cy;
-  if(E.Cx-1 == E.rows[cy-1].length && cy == E.numrows){ //check if cursor is at the end of the row it's on and if current row is 
-      appendRow();                                      //the bottom row
-      incrementCursor(0,1,0,0); //move cursor down
-  }else if (E.Cx-1 == E.rows[cy-1].length){ //cursor at end of row but not on bottom row
-      appendRow();
-      shiftRowsDown(cy-1);
-
-      memset(E.rows[cy].chars, 0, E.rows[cy].capacity);
-      E.rows[cy].chars[0] = '\0';
-      E.rows[cy].length = 0;
+  free_all_rows();
+  free(journal.entries);
+  free(journal.text);
+  free(journal.scratch);
+  clearHighlightCache();
+  free(hlCache.entries);
+  free(CURRENT_FILENAME);
+  free(saveJob->pieces); //free_all_rows() waited for the save
+  free(saveJob->retired);
+  pthread_mutex_destroy(&saveJob->lock);
+  free(saveJob);
+  free(snapshots.orphans);
+  free(snapshots.stamps);
+  memset(&journal, 0, sizeof(journal));
+  memset(&hlCache, 0, sizeof(hlCache));
+  memset(&snapshots, 0, sizeof(snapshots));
+  CURRENT_FILENAME = NULL;
+  saveJob = NULL;
+}
 
-      incrementCursor(0,1,0,0); //move cursor down
-  }else if(E.Cx-1 != E.rows[cy-1].length && E.Cx-1 != 0){ 
-          //cursor not at end of row or beginning of row 
-    appendRow();
+/*** Row Manipulation Methods ***/
+int rowShared(row *r){
+  /***
+   * Returns 1 if the background search or save may be reading the row's text
+   */
+  if(r->chars == NULL || r->snapshot == 0) return 0;
+  return (searchJob.running && r->snapshot >= searchJob.id) || (saveJob != NULL && saveJob->running && r->snapshot >= saveJob->id);
+}
+
+void rowUnshare(row *r){
+  /***
+   * Give a row its own copy of its text if a background search or save may be reading the current one, every method
+   * that changes a row's chars in place calls this first. The old copy is freed when the jobs are done with it
+   */
+  if(!rowShared(r)) return;
+  char *copy = malloc(r->capacity);
+  if(copy == NULL){
+    printf("Memory allocation failed\n");
+    exit(1);
+  }
+  memcpy(copy, r->chars, r->capacity);
+  rowFreeChars(r);
+  r->chars = copy;
+}
+
+void rowFreeChars(row *r){
+  /***
+   * Free a row's text, or keep it to free later if a background search or save may be reading it
+   */
+  if(rowShared(r)){
+    if(snapshots.numOrphans == snapshots.orphanCapacity){
+      snapshots.orphanCapacity = GROW_CAPACITY(snapshots.orphanCapacity);
+      snapshots.orphans = realloc(snapshots.orphans, sizeof(char *) * snapshots.orphanCapacity);
+      snapshots.stamps = realloc(snapshots.stamps, sizeof(unsigned int) * snapshots.orphanCapacity);
+      if(snapshots.orphans == NULL || snapshots.stamps == NULL){
+        printf("Memory allocation failed\n");
+        exit(1);
+      }
+    }
+    snapshots.stamps[snapshots.numOrphans] = r->snapshot;
+    snapshots.orphans[snapshots.numOrphans++] = r->chars;
+  } else {
+    free(r->chars);
+  }
+  r->chars = NULL;
+  r->snapshot = 0;
+}
+
+void releaseOrphans(void){
+  /***
+   * Free the replaced row text no running search or save can be reading anymore, called when one of them stops
+   */
+  int kept = 0;
+  for(int i = 0; i < snapshots.numOrphans; i++){
+    unsigned int stamp = snapshots.stamps[i];
+    if((searchJob.running && stamp >= searchJob.id) || (saveJob != NULL && saveJob->running && stamp >= saveJob->id)){
+      snapshots.stamps[kept] = stamp;
+      snapshots.orphans[kept++] = snapshots.orphans[i];
+    } else {
+      free(snapshots.orphans[i]);
+    }
+  }
+  snapshots.numOrphans = kept;
+}
+
+void setChars(row *row, char *chars, int strlen){
+  /***
+   * Sets the characters of row to chars, the gap is left at the end of the row
+   */
+  size_t capacity = MIN_ROW_CAPACITY;
+  while(capacity < (size_t)strlen + 2) capacity = GROW_CAPACITY(capacity); //+2 for the gap and null terminator
+
+  rowFreeChars(row); //free row's chars before reassignment
+
+  char *new_chars = malloc(capacity); //make a new_chars to copy chars to row
+  if(new_chars == NULL){
+    printf("Memory allocation failed\n");
+    exit(1);
+  }
+  memcpy(new_chars, chars, strlen);
+  row->chars = new_chars;
+  row->capacity = capacity;
+
+  row->length = strlen;
+  row->gapStart = strlen;
+  row->gapEnd = capacity - 1;
+  row->chars[strlen] = '\0'; //make sure chars is null terminated
+  row->chars[capacity - 1] = '\0';
+  row->version++;
+} 
+
+row duplicate_row(row *original) {
+  /***
+   * Creates a duplicate row of original
+   */
+
+  // Initialize a new row
+  row new_row;
+
+  new_row.chars = malloc(original->capacity * sizeof(char));
+  if (new_row.chars == NULL) {
+      // Handle memory allocation failure
+      new_row.length = 0;
+      new_row.capacity = 0;
+      return new_row;
+  }
+
+  //copy both halves of original's gap buffer to new_row's chars, the gap itself doesn't need copying
+  memcpy(new_row.chars, original->chars, original->gapStart + 1);//+1 for null terminator
+  memcpy(new_row.chars + original->gapEnd, original->chars + original->gapEnd, original->capacity - original->gapEnd);
+
+  // Copy other properties
+  new_row.length = original->length;
+  new_row.capacity = original->capacity;
+  new_row.gapStart = original->gapStart;
+  new_row.gapEnd = original->gapEnd;
+  return new_row;
+}
+
+void initializeRowMemory(row *r, size_t capacity) {
+  /***
+   * Allocates memory for a newly created row and initializes its fields
+   */
+  //initialize chars to have MIN_ROW_CAPACITY bytes
+  r->chars = malloc(capacity);
+  r->capacity = capacity;
+  if (r->chars == NULL) {
+      // Handle memory allocation failure
+      exit(1);
+  }
+  //the whole row is gap, the first and last characters are null terminators
+  r->chars[0] = '\0';
+  r->chars[capacity - 1] = '\0';
+  r->length = 0;
+  r->gapStart = 0;
+  r->gapEnd = capacity - 1;
+  r->version++;
+}
+
+void rowMoveGap(row *r, int index){
+  /***
+   * Move the gap of a row so it starts at index, only the characters between the old and new
+   * gap positions are moved
+   */
+  if(index != r->gapStart) rowUnshare(r);
+  if(index < r->gapStart){
+    int count = r->gapStart - index;
+    memmove(r->chars + r->gapEnd - count, r->chars + index, count);
+    r->gapStart -= count;
+    r->gapEnd -= count;
+  } else if(index > r->gapStart){
+    int count = index - r->gapStart;
+    memmove(r->chars + r->gapStart, r->chars + r->gapEnd, count);
+    r->gapStart += count;
+    r->gapEnd += count;
+  }
+  r->chars[r->gapStart] = '\0'; //keep the text before the gap null terminated
+}
+
+void rowGrowGap(row *r, int needed){
+  /***
+   * Make sure the gap of a row has room for needed more characters, the gap always keeps at least
+   * one byte free so the text before it can be null terminated
+   */
+  if(r->gapEnd - r->gapStart > needed) return;
+  rowUnshare(r);
+
+  size_t tail = r->capacity - r->gapEnd; //text after the gap plus the null terminator
+  size_t new_capacity = GROW_CAPACITY(r->capacity);
+  while(new_capacity < (size_t)r->length + needed + 2) new_capacity = GROW_CAPACITY(new_capacity);
+
+  char *new_chars = realloc(r->chars, new_capacity);
+  if(new_chars == NULL){
+    printf("Memory allocation failed\n");
+    exit(1);
+  }
+  //move the text after the gap to the end of the new memory, the new space becomes part of the gap
+  memmove(new_chars + new_capacity - tail, new_chars + r->gapEnd, tail);
+  r->chars = new_chars;
+  r->gapEnd = new_capacity - tail;
+  r->capacity = new_capacity;
+}
+
+char* rowChars(row *r){
+  /***
+   * Returns the text of a row as one contiguous null terminated string by moving the gap to the end
+   * of the row
+   */
+  rowMoveGap(r, r->length);
+  return r->chars;
+}
+
+char rowCharAt(row *r, int index){
+  /***
+   * Returns the character at index in a row, or the null terminator if index is past the end
+   */
+  if(index < 0 || index >= r->length) return '\0';
+  if(index < r->gapStart) return r->chars[index];
+  return r->chars[index + r->gapEnd - r->gapStart];
+}
+
+void rowInsertChar(row *r, int index, char c){
+  /***
+   * Insert c into a row at index, the gap is moved to index first so repeated inserts at the same
+   * spot don't move any other characters
+   */
+  rowUnshare(r);
+  rowGrowGap(r, 1);
+  rowMoveGap(r, index);
+  r->chars[r->gapStart++] = c;
+  r->chars[r->gapStart] = '\0';
+  r->length++;
+  r->version++;
+}
+
+void rowDeleteChar(row *r, int index){
+  /***
+   * Delete the character at index in a row by widening the gap over it
+   */
+  if(index < 0 || index >= r->length) return;
+  rowUnshare(r);
+  if(index == r->gapStart - 1){ //backspacing right before the gap
+    r->gapStart--;
+    r->chars[r->gapStart] = '\0';
+  } else {
+    rowMoveGap(r, index);
+    r->gapEnd++;
+  }
+  r->length--;
+  r->version++;
+}
+
+void rowTruncate(row *r, int index){
+  /***
+   * Cut off a row at index, everything after index is dropped
+   */
+  if(index >= r->length) return;
+  rowUnshare(r);
+  rowMoveGap(r, index);
+  r->gapEnd = r->capacity - 1;
+  r->length = index;
+  r->version++;
+}
+
+void rowAppend(row *r, char *chars, int len){
+  /***
+   * Append len characters of chars to the end of a row
+   */
+  rowUnshare(r);
+  rowGrowGap(r, len);
+  rowMoveGap(r, r->length);
+  memcpy(r->chars + r->gapStart, chars, len);
+  r->gapStart += len;
+  r->length += len;
+  r->chars[r->gapStart] = '\0';
+  r->version++;
+}
+
+void rowInsert(row *r, int index, const char *chars, int len){
+  /***
+   * Insert len characters of chars into a row at index
+   */
+  rowUnshare(r);
+  rowGrowGap(r, len);
+  rowMoveGap(r, index);
+  memcpy(r->chars + r->gapStart, chars, len);
+  r->gapStart += len;
+  r->chars[r->gapStart] = '\0';
+  r->length += len;
+  r->version++;
+}
+
+void rowDelete(row *r, int index, int len){
+  /***
+   * Delete len characters of a row starting at index by widening the gap over them
+   */
+  rowUnshare(r);
+  rowMoveGap(r, index);
+  r->gapEnd += len;
+  r->length -= len;
+  r->version++;
+}
+
+void rowCopy(row *r, int index, int len, char *out){
+  /***
+   * Copy len characters of a row starting at index into out without moving the gap
+   */
+  int before = index < r->gapStart ? r->gapStart - index : 0; //how many of them come before the gap
+  if(before > len) before = len;
+  memcpy(out, r->chars + index, before);
+  memcpy(out + before, r->chars + r->gapEnd + (index + before - r->gapStart), len - before);
+}
+
+int rowContains(row *r, char *needle){
+  /***
+   * Check if needle occurs in a row without moving the gap, the halves on either side of the gap
+   * are searched on their own and then the characters straddling the gap are checked
+   */
+  if(strstr(r->chars, needle) != NULL || strstr(r->chars + r->gapEnd, needle) != NULL) return 1;
+
+  int needleLen = strlen(needle);
+  if(needleLen < 2 || r->gapStart == 0 || r->gapEnd == (int)r->capacity - 1) return 0;
+  char straddle[2 * MAX_STRADDLE + 1];
+  if(needleLen - 1 > MAX_STRADDLE) return strstr(rowChars(r), needle) != NULL;
+  int before = r->gapStart < needleLen - 1 ? r->gapStart : needleLen - 1;
+  int after = (int)r->capacity - 1 - r->gapEnd;
+  if(after > needleLen - 1) after = needleLen - 1;
+  memcpy(straddle, r->chars + r->gapStart - before, before);
+  memcpy(straddle + before, r->chars + r->gapEnd, after);
+  straddle[before + after] = '\0';
+  return strstr(straddle, needle) != NULL;
+}
+
+/*** Row Tree Methods ***/
+unsigned int nextPriority(void){
+  /***
+   * Returns a random treap priority
+   */
+  static unsigned int seed = 2463534242u; //xorshift state used to pick random priorities
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  return seed;
+}
+
+rownode* allocRowNode(void){
+  /***
+   * Take a row node from the node pool, reusing a deleted node if there is one
+   */
+  rownode *node;
+  if(pool.freeList != NULL){
+    node = pool.freeList;
+    pool.freeList = node->right;
+  } else {
+    if(pool.chunk == NULL || pool.chunkUsed == pool.chunkSize){ //the current chunk is used up
+      int size = pool.chunkSize < MIN_POOL_CHUNK ? MIN_POOL_CHUNK : pool.chunkSize * 2;
+      pool.chunks = realloc(pool.chunks, sizeof(void *) * (pool.numChunks + 1));
+      pool.chunk = malloc(sizeof(rownode) * size);
+      if(pool.chunks == NULL || pool.chunk == NULL){
+        printf("Memory allocation failed\n");
+        exit(1);
+      }
+      pool.chunks[pool.numChunks++] = pool.chunk;
+      pool.chunkSize = size;
+      pool.chunkUsed = 0;
+    }
+    node = &pool.chunk[pool.chunkUsed++];
+    node->r.version = 0; //a reused node keeps counting from its old version so stale cached rows never match it
+  }
+  node->priority = nextPriority();
+  node->left = NULL;
+  node->right = NULL;
+  node->parent = NULL;
+  node->size = 1;
+  node->lines = 1;
+  node->commentIn = 0;
+  node->matches = 0;
+  node->searched = 0;
+  node->r.snapshot = 0;
+  node->born = snapshots.lastId;
+  return node;
+}
+
+rownode* reserveRowNodes(size_t count){
+  /***
+   * Allocate count row nodes in one chunk, used by the loader which knows how many rows a file has
+   * before it creates any of them. The nodes are left uninitialized for the loader threads to fill in
+   */
+  pool.chunks = realloc(pool.chunks, sizeof(void *) * (pool.numChunks + 1));
+  rownode *nodes = malloc(sizeof(rownode) * count);
+  if(pool.chunks == NULL || nodes == NULL){
+    printf("Memory allocation failed\n");
+    exit(1);
+  }
+  pool.chunks[pool.numChunks++] = nodes;
+  return nodes;
+}
+
+rownode* buildRowTree(rownode *nodes, size_t count, int *height){
+  /***
+   * Build a perfectly balanced treap out of count nodes that are already in row order in O(n). A node's
+   * priority is its height in the top bits plus random low bits so every parent outranks its children
+   */
+  if(count == 0){
+    *height = 0;
+    return NULL;
+  }
+  size_t mid = count / 2;
+  int leftHeight, rightHeight;
+  rownode *node = &nodes[mid];
+  node->left = buildRowTree(nodes, mid, &leftHeight);
+  node->right = buildRowTree(nodes + mid + 1, count - mid - 1, &rightHeight);
+  node->parent = NULL;
+  *height = (leftHeight > rightHeight ? leftHeight : rightHeight) + 1;
+  node->priority = ((unsigned int)*height << 26) | (nextPriority() >> 6);
+  updateNode(node);
+  return node;
+}
+
+void freeRowNode(rownode *node){
+  /***
+   * Free a row node's text and give the node back to the pool
+   */
+  rowFreeChars(&node->r);
+  node->lines = 0; //a free node stands for no rows, so a background search can't mistake it for a span it counted
+  node->right = pool.freeList;
+  pool.freeList = node;
+}
+
+int nodeShared(rownode *node){
+  /***
+   * Returns 1 if the background save may be walking the node, every node made before the save started is in its
+   * snapshot
+   */
+  return saveJob != NULL && saveJob->running && node->born < saveJob->id;
+}
+
+rownode* copyRowNode(rownode *node){
+  /***
+   * Returns a node that can be changed in place of node, node itself unless the background save may be walking it.
+   * Then the copy takes node's place and node is kept as it is for the save. The copy shares node's text and is
+   * stamped with the save's id so the text is copied before it changes. Whoever pointed at node has to be pointed
+   * at the copy, see ownRowNode()
+   */
+  if(!nodeShared(node)) return node;
+  rownode *copy = allocRowNode();
+  unsigned int version = copy->r.version;
+  *copy = *node;
+  copy->born = snapshots.lastId;
+  copy->r.version = version + 1; //the copy's address may have cached output of another row, don't let it match
+  if(copy->r.snapshot < saveJob->id) copy->r.snapshot = saveJob->id;
+  if(copy->left != NULL) copy->left->parent = copy;
+  if(copy->right != NULL) copy->right->parent = copy;
+  if(searchFlag && node->searched != search.generation) search.uncounted = 1; //its count may go to node instead
+
+  if(saveJob->numRetired == saveJob->retiredCapacity){
+    saveJob->retiredCapacity = GROW_CAPACITY(saveJob->retiredCapacity);
+    saveJob->retired = realloc(saveJob->retired, sizeof(rownode *) * saveJob->retiredCapacity);
+    if(saveJob->retired == NULL){
+      printf("Memory allocation failed\n");
+      exit(1);
+    }
+  }
+  saveJob->retired[saveJob->numRetired++] = node;
+  return copy;
+}
+
+rownode* ownRowNode(rownode *node){
+  /***
+   * Make sure the row tree holds a node that can be changed in place of node and return it. A node the background
+   * save may be walking is copied, and so is every node above it that still points at it
+   */
+  if(!nodeShared(node)) return node;
+  rownode *parent = node->parent;
+  rownode *copy = copyRowNode(node);
+  if(parent == NULL){
+    E.rows = copy;
+    return copy;
+  }
+  parent = ownRowNode(parent);
+  if(parent->left == node){
+    parent->left = copy;
+  } else {
+    parent->right = copy;
+  }
+  copy->parent = parent;
+  return copy;
+}
+
+int nodeSize(rownode *node){
+  return node == NULL ? 0 : node->size;
+}
+
+int ownMatches(rownode *node){
+  return node->searched == search.generation ? node->matches : 0;
+}
+
+int nodeMatches(rownode *node){
+  return node == NULL || node->summed != search.generation ? 0 : node->subtreeMatches;
+}
+
+void updateNode(rownode *node){
+  /***
+   * Recompute a node's subtree size, match count, and oldest searches and point its children back at it. Counts
+   * from an older search are left out, a subtree whose sum is older has no node counted for this search in it
+   * since counting a node updates every node above it
+   */
+  node->size = node->lines + nodeSize(node->left) + nodeSize(node->right);
+  node->subtreeMatches = ownMatches(node) + nodeMatches(node->left) + nodeMatches(node->right);
+  node->summed = search.generation;
+  node->subtreeSearched = node->searched;
+  node->subtreeHit = node->matches > 0 ? node->searched : UINT_MAX;
+  for(int i = 0; i < 2; i++){
+    rownode *child = i == 0 ? node->left : node->right;
+    if(child == NULL) continue;
+    if(child->subtreeSearched < node->subtreeSearched) node->subtreeSearched = child->subtreeSearched;
+    if(child->subtreeHit < node->subtreeHit) node->subtreeHit = child->subtreeHit;
+  }
+  if(node->left != NULL) node->left->parent = node;
+  if(node->right != NULL) node->right->parent = node;
+}
+
+rownode* mergeRows(rownode *a, rownode *b){
+  /***
+   * Join two trees where every row of a comes before every row of b
+   */
+  if(a == NULL) return b;
+  if(b == NULL) return a;
+  if(a->priority > b->priority){
+    a = copyRowNode(a); //the background save keeps walking the old one
+    a->right = mergeRows(a->right, b);
+    updateNode(a);
+    return a;
+  }
+  b = copyRowNode(b);
+  b->left = mergeRows(a, b->left);
+  updateNode(b);
+  return b;
+}
+
+void splitRows(rownode *t, int k, rownode **l, rownode **r){
+  /***
+   * Split a tree so the first k rows end up in l and the rest in r
+   */
+  if(t == NULL){
+    *l = NULL;
+    *r = NULL;
+    return;
+  }
+  t = copyRowNode(t); //the background save keeps walking the old one
+  if(nodeSize(t->left) < k){ //k never falls inside a span, callers load the row at k first
+    splitRows(t->right, k - nodeSize(t->left) - t->lines, &t->right, r);
+    updateNode(t);
+    *l = t;
+  } else {
+    splitRows(t->left, k, l, &t->left);
+    updateNode(t);
+    *r = t;
+  }
+}
+
+rownode* findRowNode(int index, int *offset){
+  /***
+   * Find the node holding the row at index(0 indexed), offset is set to where the row is within the node
+   */
+  rownode *node = E.rows;
+  while(node != NULL){
+    int leftSize = nodeSize(node->left);
+    if(index < leftSize){
+      node = node->left;
+    } else if(index < leftSize + node->lines){
+      *offset = index - leftSize;
+      return node;
+    } else {
+      index -= leftSize + node->lines;
+      node = node->right;
+    }
+  }
+  return NULL;
+}
+
+rownode* rowNodeAt(int index){
+  /***
+   * Find the node of the row at index(0 indexed), this can be an unloaded span
+   */
+  int offset;
+  return findRowNode(index, &offset);
+}
+
+rownode* nextRowNode(rownode *node){
+  /***
+   * Returns the node of the row after node, used to walk the rows in order without looking each one up
+   */
+  if(node->right != NULL){
+    node = node->right;
+    while(node->left != NULL) node = node->left;
+    return node;
+  }
+  while(node->parent != NULL && node->parent->right == node) node = node->parent;
+  return node->parent;
+}
+
+row* rowAt(int index){
+  /***
+   * Returns the row at index(0 indexed), loading it from the memory mapped file if needed
+   */
+  int offset = 0;
+  rownode *node = ownRowNode(findRowNode(index, &offset)); //the row may be changed through what's returned
+  if(node->r.chars == NULL) node = loadSpanRow(node, index, offset);
+  return &node->r;
+}
+
+rownode* loadSpanRow(rownode *node, int index, int offset){
+  /***
+   * Turn line offset of an unloaded span into a real row, the lines before and after it become two
+   * smaller spans so only this one line is copied out of the mapped file
+   */
+  char *start = mapped.data + node->spanStart;
+  char *end = start + node->spanLen;
+  char *line = start;
+  for(int i = 0; i < offset; i++){
+    line = (char *)memchr(line, '\n', end - line) + 1;
+  }
+  char *lineEnd = memchr(line, '\n', end - line);
+  if(lineEnd == NULL) lineEnd = end;
+
+  int linesAfter = node->lines - offset - 1;
+  size_t beforeStart = node->spanStart;
+  size_t beforeLen = line - start - (offset > 0); //don't include the \n in front of the loaded line
+  size_t afterStart = lineEnd + 1 - mapped.data;
+  size_t afterLen = linesAfter > 0 ? (size_t)(end - lineEnd - 1) : 0;
+
+  node->lines = 1;
+  setChars(&node->r, line, lineEnd - line);
+  countNode(node); //the span's matches are split between this line and the two new spans
+  for(rownode *p = node; p != NULL; p = p->parent) updateNode(p); //the node got smaller, fix every size above it
+  commentsChanged(index); //the span was taken to have no comments in it, this line might have some
+
+  if(offset > 0){
+    rownode *before = allocRowNode();
+    before->r.chars = NULL;
+    before->lines = offset;
+    before->spanStart = beforeStart;
+    before->spanLen = beforeLen;
+    countNode(before);
+    insertNodeAt(index - offset, before);
+  }
+  if(linesAfter > 0){
+    rownode *after = allocRowNode();
+    after->r.chars = NULL;
+    after->lines = linesAfter;
+    after->spanStart = afterStart;
+    after->spanLen = afterLen;
+    countNode(after);
+    insertNodeAt(index + 1, after);
+  }
+  return node;
+}
+
+void insertNodeAt(int index, rownode *node){
+  /***
+   * Insert a node into the row tree so its first row ends up at index
+   */
+  if(node->r.chars != NULL) countNode(node); //spans are counted by whoever makes them
+  updateNode(node);
+  rownode *l, *r;
+  splitRows(E.rows, index, &l, &r);
+  E.rows = mergeRows(mergeRows(l, node), r);
+  E.rows->parent = NULL;
+  if(E.commentTo >= index) E.commentTo += node->lines; //the rows below moved down
+  commentsChanged(index + node->lines - 1);
+  commentsChanged(index);
+}
+
+row* insertRowAt(int index){
+  /***
+   * Insert a new empty row so it ends up at index, the rows from index on move down one
+   */
+  if(index < E.numrows) rowAt(index); //make sure index isn't in the middle of an unloaded span
+  rownode *node = allocRowNode();
+  initializeRowMemory(&node->r, MIN_ROW_CAPACITY);
+  insertNodeAt(index, node);
+  E.numrows++;
+  E.changes++; //a new row is a new \n in the text even when both rows are empty
+  return &node->r;
+}
+
+void deleteRowAt(int index){
+  /***
+   * Delete the row at index, the rows below it move up one
+   */
+  rowAt(index); //make sure the row is loaded so it has a node of its own
+  rownode *l, *m, *r;
+  splitRows(E.rows, index, &l, &r);
+  splitRows(r, 1, &m, &r);
+  if(m != NULL) freeRowNode(m);
+  E.rows = mergeRows(l, r);
+  if(E.rows != NULL) E.rows->parent = NULL;
+  E.numrows--;
+  E.changes++;
+  commentsChanged(index);
+}
+
+void rowEdited(int index){
+  /***
+   * Note that the text of the row at index changed, so its multiline comment state and its search matches are redone
+   */
+  E.changes++;
+  commentsChanged(index);
+  if(!searchFlag) return;
+  rownode *node = rowNodeAt(index);
+  countNode(node);
+  for(rownode *p = node; p != NULL; p = p->parent) updateNode(p);
+}
+
+void appendRow(void) {
+  /***
+   * Adds a new unitialized row to the end of the global editor object's rows
+   */
+  insertRowAt(E.numrows);
+}
+
+void splitRowAt(int index, int col){
+  /***
+   * Split the row at index in two at col, the text after col moves to a new row below it
+   */
+  row *current = rowAt(index);
+  if(col == 0 && current->length > 0){ //split at the start of the row, put the new empty row above instead of moving the text
+    insertRowAt(index);
+  } else {
+    row *below = insertRowAt(index + 1);
+    if(col < current->length){ //move the text after col to the new row
+      int copy_length = current->length - col; //the length of how much of the string to move to the next row down
+      rowMoveGap(current, col); //the text after the gap is now exactly the text to move down
+      setChars(below, current->chars + current->gapEnd, copy_length);
+      rowTruncate(current, col); //cut off the current row at col
+      rowEdited(index);
+      rowEdited(index + 1);
+    }
+  }
+}
+
+void insertText(int index, int col, const char *text, int len, int *endRow, int *endCol){
+  /***
+   * Insert len bytes of text at column col of the row at index, every \n in the text starts a new row. endRow and endCol
+   * are set to where the text ends. The row is split once and the lines of the text go in between, so this takes
+   * time in proportion to the text and not to the rows after it
+   */
+  const char *nl = memchr(text, '\n', len);
+  if(nl == NULL){
+    rowInsert(rowAt(index), col, text, len);
+    rowEdited(index);
+    *endRow = index;
+    *endCol = col + len;
+    return;
+  }
+  splitRowAt(index, col);
+  rowAppend(rowAt(index), (char *)text, nl - text);
+  rowEdited(index);
+  const char *line = nl + 1;
+  for(nl = memchr(line, '\n', text + len - line); nl != NULL; nl = memchr(line, '\n', text + len - line)){
+    row *r = insertRowAt(++index);
+    setChars(r, (char *)line, nl - line);
+    rowEdited(index);
+    line = nl + 1;
+  }
+  index++; //the row holding the text that was after col
+  rowInsert(rowAt(index), 0, line, text + len - line);
+  rowEdited(index);
+  *endRow = index;
+  *endCol = text + len - line;
+}
+
+void deleteText(int index, int col, int len, char *removed){
+  /***
+   * Delete len bytes starting at column col of the row at index, a \n is the end of a row so deleting it joins the
+   * rows on either side of it. The deleted text is copied to removed unless it's NULL. The rows the text covers
+   * completely are dropped whole, so this takes time in proportion to the text
+   */
+  row *r = rowAt(index);
+  int n = len < r->length - col ? len : r->length - col; //how much of the first row goes
+  if(removed != NULL) rowCopy(r, col, n, removed);
+  if(n == len){
+    rowDelete(r, col, n);
+    rowEdited(index);
+    return;
+  }
+  int left = len - n - 1; //what's left after the \n ending the first row
+  if(removed != NULL) removed[n] = '\n';
+  int last = index + 1; //the row the deletion ends in
+  while(last < E.numrows - 1 && left > rowAt(last)->length){
+    row *covered = rowAt(last);
+    if(removed != NULL){
+      rowCopy(covered, 0, covered->length, removed + len - left);
+      removed[len - left + covered->length] = '\n';
+    }
+    left -= covered->length + 1;
+    last++;
+  }
+  row *end = rowAt(last);
+  if(left > end->length) left = end->length; //the text ran past the end of the file
+  if(removed != NULL) rowCopy(end, 0, left, removed + len - left);
+  rowTruncate(r, col);
+  rowAppend(r, rowChars(end) + left, end->length - left);
+  for(int i = index + 1; i <= last; i++) deleteRowAt(index + 1);
+  rowEdited(index);
+}
+
+int deleteEnd(int index, int col, int len, int *endRow, int *endCol){
+  /***
+   * Find where deleting len bytes from column col of the row at index would end, returns 0 if it runs past the
+   * end of the text
+   */
+  while(len > rowAt(index)->length - col){
+    len -= rowAt(index)->length - col + 1; //the rest of the row and its \n
+    index++;
+    col = 0;
+    syncMappedRowsTo(index); //a long delete can run into lines the indexer hasn't added yet
+    if(index == E.numrows) return 0;
+  }
+  *endRow = index;
+  *endCol = col + len;
+  return 1;
+}
+
+int applyEdits(const struct nmm_edit *edits, int count, int *endRow, int *endCol){
+  /***
+   * Make a batch of edits in one pass, undone and redone as one. Every edit's position is in the text as it was
+   * before the batch, and the edits have to be in order without overlapping. They are made from the last to the
+   * first, so no edit moves the text the ones before it are at. Nothing is changed and -1 is returned if an edit
+   * is out of order or outside the text. The cursor is only put back in the text and scrolled to once at the end.
+   * endRow and endCol are set to where the first edit ends, unless they are NULL
+   */
+  int lastRow = 0;
+  int lastCol = 0;
+  for(int i = 0; i < count; i++){
+    const struct nmm_edit *edit = &edits[i];
+    syncMappedRowsTo(edit->row); //only as much of a mapped file as the edits reach has to be in the row tree
+    if(edit->row < lastRow || edit->row >= E.numrows || (edit->row == lastRow && edit->col < lastCol)) return -1;
+    if(edit->col < 0 || edit->col > rowAt(edit->row)->length) return -1;
+    if(edit->deleteLength < 0 || edit->textLength < 0 || (edit->textLength > 0 && edit->text == NULL)) return -1;
+    if(!deleteEnd(edit->row, edit->col, edit->deleteLength, &lastRow, &lastCol)) return -1;
+  }
+  char *removed = NULL; //the text each edit deletes, for the journal
+  int removedCapacity = 0;
+  journal.sealed = 1; //the batch doesn't go into an entry from before it
+  journal.batch = ++journal.lastBatch;
+  for(int i = count - 1; i >= 0; i--){
+    const struct nmm_edit *edit = &edits[i];
+    if(edit->deleteLength > 0){
+      if(edit->deleteLength > removedCapacity){
+        removedCapacity = edit->deleteLength;
+        free(removed);
+        removed = malloc(removedCapacity);
+        if(removed == NULL){
+          printf("Memory allocation failed\n");
+          exit(1);
+        }
+      }
+      deleteText(edit->row, edit->col, edit->deleteLength, removed);
+      recordDelete(edit->row, edit->col, removed, edit->deleteLength);
+    }
+    int row = edit->row;
+    int col = edit->col;
+    if(edit->textLength > 0){
+      recordInsert(edit->row, edit->col, edit->text, edit->textLength);
+      insertText(edit->row, edit->col, edit->text, edit->textLength, &row, &col);
+    }
+    if(i == 0 && endRow != NULL) *endRow = row;
+    if(i == 0 && endCol != NULL) *endCol = col;
+  }
+  free(removed);
+  journal.batch = 0;
+  journal.sealed = 1;
+  trimJournal(); //held off until the batch was all in
+  if(E.Cy > E.numrows) E.Cy = E.numrows; //the cursor's row or the text after it in its row may be gone
+  if(E.Cx > rowAt(E.Cy-1)->length + 1) E.Cx = rowAt(E.Cy-1)->length + 1;
+  scrollCheck();
+  sidescrollCheck();
+  return 0;
+}
+
+void addRow(void){
+  /***
+   * Create a new row in the text editor in response to the user pressing enter, this method handles splitting a row and copying
+   * its characters if the user presses enter in the middle of a row
+   */
+  recordInsert(E.Cy-1, E.Cx-1, "\n", 1);
+  splitRowAt(E.Cy-1, E.Cx-1);
+  incrementCursor(0,1,0,0); //move cursor down
+  E.Cx = 1; //snap the cursor to the far left of the current row
+  E.sidescroll = 0; //set sidescroll to 0
+}
+
+void removeRow(int backSpace){
+  /***
+   * Remove a row in response to the user pressing backspace or delete, this method handles copy and moving of characters
+   */
+  if(backSpace){
+    row *above = rowAt(E.Cy-2);
+    row *current = rowAt(E.Cy-1);
+    recordDelete(E.Cy-2, above->length, "\n", 1); //the \n ending the row above
+    E.Cx = above->length + 1;
+    incrementCursor(1,0,0,0); //increment cursor up
+    if(above->length == 0){ //nothing to join onto, just drop the empty row above
+      deleteRowAt(E.Cy-1);
+    } else {
+      rowAppend(above, rowChars(current), current->length); //join the row below onto the current row
+      deleteRowAt(E.Cy); //delete the row that was joined
+      rowEdited(E.Cy-1);
+    }
+  } else {
+    recordDelete(E.Cy-1, 0, "\n", 1); //the \n ending the current(empty) row
+    deleteRowAt(E.Cy-1); //delete the current(empty) row
+  }
+}
+
+int rowCount(void){
+  /***
+   * Returns the number of rows in the current buffer, a mapped file that is still being indexed only has the rows
+   * added so far
+   */
+  return E.numrows;
+}
+
+/*** Cursor Manipulation Methods ***/
+void printCursorPos(void){
+  /***
+   * Print the current position of the cursor in the bottom right of the screen
+   */
+  char buf[128];
+  char times[64] = "";
+  if(prof.hud && prof.numFrames > 0){ //the frame being drawn isn't done yet, so these are the ones before it
+    snprintf(times, sizeof(times), "frame %.2fms p99 %.2fms  ", prof.last * 1000, prof.p99 * 1000);
+  } else if(prof.hud){
+    snprintf(times, sizeof(times), "frame --  ");
+  }
+  int bufSize = snprintf(buf, sizeof(buf), "%s%sLn %d, Col %d", times, E.changes != E.savedChanges ? "* " : "",
+                         E.Cy, E.Cx)+1;
+  int offset = 22;
+  if(bufSize > 22){
+    offset = bufSize;
+  }
+  paintString(E.w.ws_row, E.w.ws_col - offset - 1, buf); //paint it into the status bar row of the grid
+}
+
+void incrementCursor(int up, int down, int left, int right){  
+  /***
+   * Increment the position of the global editor object's cursor
+   */
+    if((up^down^left^right) != 1 || up+down+left+right != 1){
+      printf("Only one parameter can be 1, all others must be 0");
+      return;
+    }
+    if(up && !down && !left && !right){ //up arrow
+      if(E.Cy > 1){
+        E.Cy--; //only deccrement if C.y is > 1, note that going up decrements C.y as the top left of the screen is 1,1
+        //keep moving the cursor left until it hits a printable character or 
+        //beginning of the row
+        if(E.Cx > rowAt(E.Cy-1)->length + 1){
+          while(E.Cx > rowAt(E.Cy-1)->length + 1){
+            E.Cx--; //snap cursor to end of row
+          }
+        }
+      }
+    } else if(!up && down && !left && !right){ //down arrow
+      if(E.Cy <= E.scroll + E.w.ws_row){ 
+        E.Cy++; //only increment C.y if y is < rows limit, the row limit is positive and represents the lowest row of the screen
+        //keep moving the cursor left until it hits a printable character or 
+        //beginning of the row
+        while(E.Cx > rowAt(E.Cy-1)->length + 1){
+          E.Cx--; //snap cursor to end of row
+        }
+      }
+    } else if(!up && !down && left && !right){ //left arrow
+      if(E.Cx > 1){
+        E.Cx--; //only increment if C.x is > 1, we have to use 1 because the cursor actually controls the character behind it
+      }
+    } else if(!up && !down && !left && right){ //right arrow
+      if(E.Cx <= E.sidescroll + E.w.ws_col){
+        E.Cx++; //only increment if C.x < columns limit, the column limit is positive and represents the farthest right column on screen
+      }
+    }
+}   
+
+void moveCursor(char *buf){
+  /***
+   * Map user arrow key presses to cursor movements
+   */
+    switch (buf[2])
+    {
+    case 'A': //up arrow
+      incrementCursor(1,0,0,0); //increment the cursor's coordinates(stored in the global editor E)
+      break;
+    case 'B': //down arrow
+      if(E.Cy <= E.numrows - 1) incrementCursor(0,1,0,0); //limit cursor to one above the lowest row
+      break;
+    case 'C': //right arrow
+      if(E.Cx <= rowAt(E.Cy-1)->length) incrementCursor(0,0,0,1); //limit cursor at only one space further right than the text
+      break;
+    case 'D': //left arrow
+      incrementCursor(0,0,1,0);
+      break;
+    default:
+      break;
+    } 
+}
+
+/*** Scrolling Methods ***/
+void scrollUp(void){
+  if(E.scroll > 0) E.scroll--;
+}
+
+void scrollDown(void){
+  E.scroll++;
+}
+
+void scrollRight(void){
+  E.sidescroll++;
+}
+
+void scrollLeft(void){
+  if(E.sidescroll > 0) E.sidescroll--;
+}
+
+void scrollCheck(void){
+  /***
+   * Check if the editor needs to scroll up or down in response to user inputs
+   */
+  if((E.Cy) - E.scroll > E.w.ws_row){
+    scrollDown();
+  } else if ((E.Cy-1) < E.scroll){
+    scrollUp();
+  }
+}
+
+void sidescrollCheck(void){
+  /***
+   * Check if the editor needs to scroll left or right in response to user inputs
+   */
+  if(E.Cx - E.sidescroll > E.w.ws_col){
+    scrollRight();
+  } else if (E.Cx-1 < E.sidescroll){
+    E.sidescroll = E.Cx-1;
+  }
+}
+
+/*** Charcater Manipulation Methods ***/
+void addPrintableChar(char c) {
+  /***
+   * Write a printable characters to the screen in response to user input
+   */
+  if (E.Cx - E.sidescroll <= E.w.ws_col) {
+    recordInsert(E.Cy-1, E.Cx-1, &c, 1);
+    //insert the new character, rowInsertChar takes care of growing the row and moving its gap
+    rowInsertChar(rowAt(E.Cy-1), E.Cx-1, c);
+    rowEdited(E.Cy-1);
+
+    E.Cx++; //increment cursor to account for the new character 
+    if(E.Cx - E.sidescroll > E.w.ws_col){ //check if we need to scroll
+      scrollRight();
+    }
+  }
+}
+
+void tabPressed(){
+  /***
+   * Write 4 spaces to the screen in response to the user pressing tab
+   */
+  for(int i = 0; i < 4; i++){
+    addPrintableChar(' ');
+  }
+}
+
+void backspacePrintableChar(void) {
+  /***
+   * Delete a printable character in response to the user pressing backspace
+   */
+  if (E.Cx > 1) {
+    char c = rowCharAt(rowAt(E.Cy-1), E.Cx-2);
+    recordDelete(E.Cy-1, E.Cx-2, &c, 1);
+    //delete the character behind the cursor, this only widens the row's gap
+    rowDeleteChar(rowAt(E.Cy-1), E.Cx-2);
+    rowEdited(E.Cy-1);
+
+    //decrement character to account for the new shorter row
+    E.Cx--;
+    if(E.Cx <= E.sidescroll){
+      scrollLeft();
+    } 
+  }
+}
+
+void deletePrintableChar(void){
+  /***
+   * Delete a printable character in response to the user pressing delete
+   */
+  if(E.Cx-1 < rowAt(E.Cy-1)->length){ //the cursor is on a character, not past the end of the row
+    char c = rowCharAt(rowAt(E.Cy-1), E.Cx-1);
+    recordDelete(E.Cy-1, E.Cx-1, &c, 1);
+    //delete the character under the cursor, this only widens the row's gap
+    rowDeleteChar(rowAt(E.Cy-1), E.Cx-1);
+    rowEdited(E.Cy-1);
+    //DO NOT decrement character to account for the new shorter row
+    //this is how delete is different from backspace
+  }
+}
+
+/*** Undo Journal ***/
+void initJournal(void){
+  /***
+   * Start the undo journal empty, NOTEPADMM_UNDO_LIMIT can set how much memory it may take in bytes, or with a
+   * K, M, or G after the number
+   */
+  memset(&journal, 0, sizeof(journal));
+  journal.limit = UNDO_LIMIT;
+  char *limit = getenv("NOTEPADMM_UNDO_LIMIT");
+  if(limit == NULL) return;
+  char *unit;
+  long long bytes = strtoll(limit, &unit, 10);
+  if(*unit == 'k' || *unit == 'K') bytes <<= 10;
+  if(*unit == 'm' || *unit == 'M') bytes <<= 20;
+  if(*unit == 'g' || *unit == 'G') bytes <<= 30;
+  if(bytes >= 0) journal.limit = bytes;
+}
+
+size_t journalBytes(void){
+  /***
+   * Returns how much memory the journal's entries and their text take
+   */
+  return journal.textLength + journal.numEntries * sizeof(struct undo_entry);
+}
+
+void appendUndoText(const char *text, int len){
+  /***
+   * Add text to the end of the journal's text
+   */
+  if(journal.textLength + len > journal.textCapacity){
+    while(journal.textLength + len > journal.textCapacity) journal.textCapacity = GROW_CAPACITY(journal.textCapacity);
+    journal.text = realloc(journal.text, journal.textCapacity);
+    if(journal.text == NULL){
+      printf("Memory allocation failed\n");
+      exit(1);
+    }
+  }
+  memcpy(journal.text + journal.textLength, text, len);
+  journal.textLength += len;
+}
+
+void trimJournal(void){
+  /***
+   * Drop the oldest entries once the journal takes more than its limit, down to three quarters of it so the rest
+   * of the journal isn't moved up again on the next keystroke. A batch is dropped whole or not at all, so undo
+   * never reverts half of one, and nothing is dropped while a batch is still being recorded
+   */
+  if(journal.batch != 0 || journalBytes() <= journal.limit) return;
+  int drop = 0;
+  size_t bytes = journalBytes();
+  while(drop < journal.numEntries && bytes > journal.limit / 4 * 3){
+    bytes -= journal.entries[drop].length + sizeof(struct undo_entry);
+    drop++;
+  }
+  while(drop > 0 && drop < journal.numEntries && journal.entries[drop].batch != 0 &&
+        journal.entries[drop].batch == journal.entries[drop - 1].batch){ //the rest of the batch goes too
+    drop++;
+  }
+  size_t textStart = drop < journal.numEntries ? journal.entries[drop].text : journal.textLength;
+  memmove(journal.text, journal.text + textStart, journal.textLength - textStart);
+  journal.textLength -= textStart;
+  memmove(journal.entries, journal.entries + drop, sizeof(struct undo_entry) * (journal.numEntries - drop));
+  journal.numEntries -= drop;
+  for(int i = 0; i < journal.numEntries; i++) journal.entries[i].text -= textStart;
+  journal.current = journal.current > drop ? journal.current - drop : 0;
+  journal.dropped += drop;
+}
+
+struct undo_entry* addUndoEntry(int kind, int index, int col, const char *text, int len){
+  /***
+   * Add an edit to the end of the journal, the edits that were undone before it can't be redone anymore
+   */
+  if(journal.current < journal.numEntries){
+    journal.textLength = journal.entries[journal.current].text;
+    journal.numEntries = journal.current;
+  }
+  if(journal.numEntries == journal.entryCapacity){
+    journal.entryCapacity = GROW_CAPACITY(journal.entryCapacity);
+    journal.entries = realloc(journal.entries, sizeof(struct undo_entry) * journal.entryCapacity);
+    if(journal.entries == NULL){
+      printf("Memory allocation failed\n");
+      exit(1);
+    }
+  }
+  struct undo_entry *entry = &journal.entries[journal.numEntries++];
+  entry->kind = kind;
+  entry->row = index;
+  entry->col = col;
+  entry->text = journal.textLength;
+  entry->length = len;
+  entry->oneLine = memchr(text, '\n', len) == NULL;
+  entry->backward = 0;
+  entry->cursorX = E.Cx;
+  entry->cursorY = E.Cy;
+  entry->batch = journal.batch;
+  appendUndoText(text, len);
+  journal.current = journal.numEntries;
+  journal.sealed = 0;
+  return entry;
+}
+
+struct undo_entry* lastUndoEntry(void){
+  /***
+   * Returns the entry the next keystroke could go into, or NULL if it has to start a new one
+   */
+  if(journal.sealed || journal.numEntries == 0 || journal.current < journal.numEntries) return NULL;
+  struct undo_entry *last = &journal.entries[journal.numEntries - 1];
+  return last->oneLine ? last : NULL;
+}
+
+void recordInsert(int index, int col, const char *text, int len){
+  /***
+   * Put an insert of len bytes of text at column col of the row at index into the journal, called before the text
+   * is inserted. A character typed right after the last one goes into the same entry
+   */
+  struct undo_entry *last = lastUndoEntry();
+  if(last != NULL && last->kind == UNDO_INSERT && len == 1 && text[0] != '\n' && last->row == index && last->col + last->length == col){
+    appendUndoText(text, 1);
+    last->length++;
+  } else {
+    addUndoEntry(UNDO_INSERT, index, col, text, len);
+  }
+  trimJournal();
+}
+
+void recordDelete(int index, int col, const char *text, int len){
+  /***
+   * Put a delete of the len bytes of text at column col of the row at index into the journal, called before the text
+   * is deleted. A backspace right before the last one, or a delete at the same spot as the last one, goes into the same entry
+   */
+  struct undo_entry *last = lastUndoEntry();
+  if(last != NULL && last->kind == UNDO_DELETE && len == 1 && text[0] != '\n' && last->row == index){
+    if(col + 1 == last->col && (last->length == 1 || last->backward)){ //backspace
+      last->backward = 1;
+      last->col = col;
+      appendUndoText(text, 1);
+      last->length++;
+      trimJournal();
+      return;
+    }
+    if(col == last->col && !last->backward){ //delete
+      appendUndoText(text, 1);
+      last->length++;
+      trimJournal();
+      return;
+    }
+  }
+  addUndoEntry(UNDO_DELETE, index, col, text, len);
+  trimJournal();
+}
+
+char* undoText(struct undo_entry *entry){
+  /***
+   * Returns the text of an entry in the order it is in the rows
+   */
+  char *text = journal.text + entry->text;
+  if(!entry->backward) return text;
+  if((size_t)entry->length > journal.scratchCapacity){
+    journal.scratchCapacity = entry->length;
+    journal.scratch = realloc(journal.scratch, journal.scratchCapacity);
+    if(journal.scratch == NULL){
+      printf("Memory allocation failed\n");
+      exit(1);
+    }
+  }
+  for(int i = 0; i < entry->length; i++) journal.scratch[i] = text[entry->length - 1 - i];
+  return journal.scratch;
+}
+
+void journalStatus(const char *what){
+  /***
+   * Say in the status bar what was undone or redone, how many of the journal's edits are done, and how much memory
+   * the journal takes
+   */
+  snprintf(statusMessage, sizeof(statusMessage), "%s (%d of %d, journal %.1f KB)", what,
+    journal.current, journal.numEntries, journalBytes() / 1024.0);
+}
+
+void undoEdit(void){
+  /***
+   * Undo the last edit that is done and put the cursor back where it was before the edit
+   */
+  if(journal.current == 0){
+    journalStatus("Nothing to undo");
+    return;
+  }
+  struct undo_entry *entry;
+  do{ //the edits of a batch are undone together, the last first
+    entry = &journal.entries[--journal.current];
+    if(entry->kind == UNDO_INSERT){
+      deleteText(entry->row, entry->col, entry->length, NULL);
+    } else {
+      int endRow, endCol;
+      insertText(entry->row, entry->col, undoText(entry), entry->length, &endRow, &endCol);
+    }
+  } while(entry->batch != 0 && journal.current > 0 && journal.entries[journal.current - 1].batch == entry->batch);
+  journal.sealed = 1;
+  moveCursorTo(entry->cursorY-1, entry->cursorX-1, entry->cursorX-1);
+  journalStatus("Undid an edit");
+}
+
+void redoEdit(void){
+  /***
+   * Make the first undone edit again and put the cursor at the end of it
+   */
+  if(journal.current == journal.numEntries){
+    journalStatus("Nothing to redo");
+    return;
+  }
+  struct undo_entry *entry;
+  do{ //the edits of a batch are redone together
+    entry = &journal.entries[journal.current++];
+    if(entry->kind == UNDO_INSERT){
+      int endRow, endCol;
+      insertText(entry->row, entry->col, undoText(entry), entry->length, &endRow, &endCol);
+      moveCursorTo(endRow, endCol, endCol);
+    } else {
+      deleteText(entry->row, entry->col, entry->length, NULL);
+      moveCursorTo(entry->row, entry->col, entry->col);
+    }
+  } while(entry->batch != 0 && journal.current < journal.numEntries &&
+          journal.entries[journal.current].batch == entry->batch);
+  journal.sealed = 1;
+  journalStatus("Redid an edit");
+}
+
+/*** User Input Processing ***/
+void openPrompt(int regex){
+  /***
+   * Open the prompt for a search, or a regex search if regex is 1
+   */
+  prompt.active = 1;
+  prompt.save = 0;
+  prompt.regex = regex;
+  prompt.label = regex ? "Regex: " : "Search: ";
+  prompt.query[0] = '\0';
+  prompt.length = 0;
+  prompt.x = E.Cx;
+  prompt.y = E.Cy;
+  prompt.scroll = E.scroll;
+  prompt.sidescroll = E.sidescroll;
+  promptSearch();
+}
+
+void promptSearch(void){
+  /***
+   * Search for the query typed so far and move to its first match. When a plain query only got longer, the rows
+   * that had no match of it before can't have one now, so only the rows that had matches are searched again
+   */
+  stopSearchJob(); //the worker reads searchQuery
+  int narrowing = searchFlag && !prompt.regex && strncmp(prompt.query, searchQuery, search.length) == 0;
+  memcpy(searchQuery, prompt.query, prompt.length + 1);
+  prompt.error = compileSearch(prompt.regex);
+  int len = snprintf(statusMessage, sizeof(statusMessage), "%s%s", prompt.label, prompt.query);
+  if(prompt.error != NULL) snprintf(statusMessage + len, sizeof(statusMessage) - len, "  (%s)", prompt.error);
+  hlCache.searchStamp++; //every row's search highlighting is different now
+  searchFlag = prompt.length > 0 && prompt.error == NULL;
+  if(searchFlag) startSearch(narrowing);
+  promptJump();
+}
+
+void promptJump(void){
+  /***
+   * Move to the first match at or after where the cursor was when the prompt opened, or to the first match of the
+   * file if there are none after it. The cursor stays where it was if nothing matches
+   */
+  E.Cx = prompt.x;
+  E.Cy = prompt.y;
+  E.scroll = prompt.scroll;
+  E.sidescroll = prompt.sidescroll;
+  prompt.jumpPending = 0;
+  if(!searchFlag) return;
+  if(searchJob.running){ //the counts aren't all in, look through the text after the cursor instead
+    prompt.jumpPending = !findMatchAhead(SEARCH_INLINE);
+    return;
+  }
+  int total = nodeMatches(E.rows);
+  if(total == 0) return;
+  int k = matchesBeforeRow(E.Cy-1) + matchesBeforeColumn(rowAt(E.Cy-1), E.Cx-1);
+  jumpToMatch(k < total ? k : 0);
+}
+
+void closePrompt(int keep){
+  /***
+   * Close the prompt, leaving the search on at the match the cursor moved to if keep is 1, or turning it off and putting
+   * the cursor back if keep is 0
+   */
+  prompt.active = 0;
+  prompt.jumpPending = 0;
+  if(keep && searchFlag) return;
+  if(keep && prompt.error != NULL){ //say what's wrong with the pattern
+    snprintf(statusMessage, sizeof(statusMessage), "Bad regex: %s", prompt.error);
+  } else {
+    statusMessage[0] = '\0';
+  }
+  if(!keep){
+    E.Cx = prompt.x;
+    E.Cy = prompt.y;
+    E.scroll = prompt.scroll;
+    E.sidescroll = prompt.sidescroll;
+  }
+  if(searchFlag){
+    searchFlag = 0;
+    hlCache.searchStamp++;
+    stopSearchJob();
+  }
+}
+
+void promptChanged(void){
+  /***
+   * Show the query after it changed, a search query is searched for right away
+   */
+  if(prompt.save){
+    snprintf(statusMessage, sizeof(statusMessage), "%s%s", prompt.label, prompt.query);
+  } else {
+    promptSearch();
+  }
+}
+
+void promptKeypress(char c){
+  /***
+   * Handle a key pressed while the search prompt is open
+   * 1. Printable characters and backspace change the query, which is searched for right away
+   * 2. Enter closes the prompt and keeps the search on
+   * 3. Escape closes the prompt, turns the search off, and puts the cursor back
+   * 4. ctrl+n and ctrl+p move between the matches like they do once the search is on
+   * The filename prompt takes the same keys, enter saves and escape closes it without saving
+   */
+  int ascii_code = (int)c;
+  if(ascii_code >= 32 && ascii_code < 127){
+    if(prompt.length == (int)sizeof(prompt.query) - 1) return;
+    prompt.query[prompt.length++] = c;
+    prompt.query[prompt.length] = '\0';
+    promptChanged();
+  } else if(ascii_code == 127){ //backspace
+    if(prompt.length == 0) return;
+    prompt.query[--prompt.length] = '\0';
+    promptChanged();
+  } else if(ascii_code == 13){ //enter
+    if(prompt.save) closeSavePrompt(1);
+    else closePrompt(1);
+  } else if(ascii_code == 27){ //escape on its own, arrow keys and the like don't do anything in the prompt
+    if(prompt.save) closeSavePrompt(0);
+    else closePrompt(0);
+  } else if((c == CTRL_KEY('n') || c == CTRL_KEY('p')) && searchFlag && !prompt.save){
+    prompt.jumpPending = 0; //the user picked a match themselves
+    searchNext(c == CTRL_KEY('n'));
+  }
+}
+
+void sortEscapes(char *seq, int len){
+  /***
+   * Determine whether or not the user pressed delete or an arrow key or pasted text and call the appropriate methods,
+   * seq is the whole escape sequence
+   */
+  if(len == 6 && memcmp(seq, "\x1b[200~", 6) == 0){ //the start of a paste
+    pasteText();
+  } else if(len == 4 && memcmp(seq, "\x1b[3~", 4) == 0){ //delete key was pressed
+    if(rowAt(E.Cy-1)->length != 0){ //check if the row isn't empty
+      int current_char = (int)rowCharAt(rowAt(E.Cy-1), E.Cx - 1);
+      if(current_char >= 32 && current_char < 127){ //check if the current character the cursor is on is a printable character
+        deletePrintableChar();
+      }
+    } else if(E.Cy != E.numrows){ //check that the cursor isn't on the bottom row
+      removeRow(0);
+    }
+  } else if(len == 3 && seq[2] >= 'A' && seq[2] <= 'D'){ //arrow key was pressed, as \x1b[A or \x1bOA
+    journal.sealed = 1; //typing somewhere else starts a new undo entry
+    moveCursor(seq); //moveCursor will only increment C's position
+  }
+}
+
+void sortKeypress(char c){
+  /***
+   * This function will determine based on the key pressed if the desired action should be
+   * 1. Insert a printable character
+   * 2. Move the cursor(this doesn't actually write/delete any characters or create/delete rows
+   *    it only sends a command to the terminal)
+   * 3. Delete a character(backspace)         
+   * 4. Shift all characters in a row(space)
+   * 5. Create a new line(enter)
+   * 6. Delete a row(backspace or enter)
+   * 7. Save File(ctrl+s)
+   * 8. Search for word(ctrl+b) or regex(ctrl+r)
+   * 9. Jump to the next or previous match of the search(ctrl+n and ctrl+p)
+   * 10. Undo or redo an edit(ctrl+z and ctrl+y)
+   * 11. Show or hide how long the frames take(ctrl+t)
+   * 12. Switch to the next open file(ctrl+o)
+   * Each of these (1-12) will have their own function(s), which sortKeypress will call
+   */
+  int ascii_code = (int)c;
+  if(ascii_code >= 32 && ascii_code < 127){ //the character inputted is a printable character
+    addPrintableChar(c);
+  } else if (ascii_code == 13){ //user pressed enter
+    addRow();
+  } else if (ascii_code == 127){ //user pressed backspace
+    if((E.Cx-1 == 0) && (E.Cy > 1)){ //check if cursor is at far left of screen and not on the highest row
+      removeRow(1);
+    }else{
+      backspacePrintableChar();
+    }
+  } else if (ascii_code == 9){ //tab was pressed
+    tabPressed();
+  } else if (c == CTRL_KEY('s')){ //ctrl+s was pressed
+    saveFile();
+  }else if (c == CTRL_KEY('b') || c == CTRL_KEY('r')){ //ctrl+b or ctrl+r was pressed, ctrl+r searches for a regex
+    if(searchFlag == 0){ //the search turns on as its query is typed into the prompt
+      openPrompt(c == CTRL_KEY('r'));
+    } else {
+      searchFlag = 0;
+      hlCache.searchStamp++; //every row's search highlighting is different now
+      stopSearchJob();
+      statusMessage[0] = '\0';
+    }
+  } else if (c == CTRL_KEY('n') && searchFlag){ //ctrl+n was pressed, go to the next match
+    searchNext(1);
+  } else if (c == CTRL_KEY('p') && searchFlag){ //ctrl+p was pressed, go to the previous match
+    searchNext(0);
+  } else if (c == CTRL_KEY('z')){ //ctrl+z was pressed, undo the last edit
+    undoEdit();
+  } else if (c == CTRL_KEY('y')){ //ctrl+y was pressed, redo the last undone edit
+    redoEdit();
+  } else if (c == CTRL_KEY('t')){ //ctrl+t was pressed, show or hide the frame times
+    toggleFrameTimes();
+  } else if (c == CTRL_KEY('o')){ //ctrl+o was pressed, switch to the next open file
+    nextBuffer();
+  } else { //one of the unmapped keys was pressed so just do nothing
+    return;
+  }
+}
+
+void onResize(int sig){
+  /***
+   * SIGWINCH handler, it only wakes up the main loop which does the resizing
+   */
+  (void)sig;
+  int saved = errno;
+  if(write(loop.resizePipe[1], "r", 1) == -1){} //the pipe being full means a wakeup is already waiting
+  errno = saved;
+}
+
+void initEventLoop(void){
+  /***
+   * Set up the pipe the window size changes come through and read the frame rate cap from NOTEPADMM_FPS
+   */
+  if(pipe(loop.resizePipe) == -1){
+    perror("pipe");
+    exit(1);
+  }
+  for(int i = 0; i < 2; i++){
+    fcntl(loop.resizePipe[i], F_SETFL, O_NONBLOCK);
+    fcntl(loop.resizePipe[i], F_SETFD, FD_CLOEXEC);
+  }
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = onResize;
+  action.sa_flags = SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGWINCH, &action, NULL);
+  char *fps = getenv("NOTEPADMM_FPS");
+  loop.frameInterval = fps != NULL && atoi(fps) > 0 ? 1.0 / atoi(fps) : 0;
+  char *record = getenv("NOTEPADMM_RECORD");
+  loop.recordFd = record != NULL ? open(record, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644) : -1;
+}
+
+ssize_t readTerminal(char *buf, size_t len){
+  /***
+   * read() from the terminal, copying what was read to the recording if there is one
+   */
+  ssize_t n = read(STDIN_FILENO, buf, len);
+  if(n > 0 && loop.recordFd != -1 && write(loop.recordFd, buf, n) != n){
+    close(loop.recordFd); //stop recording rather than leave out keys
+    loop.recordFd = -1;
+  }
+  return n;
+}
+
+void feedKeys(const char *keys, size_t len){
+  /***
+   * Put keys in the input buffer as if the terminal had sent them, so the editor can be driven without one
+   */
+  if(input.capacity < input.length + len){
+    input.capacity = input.length + len;
+    input.data = realloc(input.data, input.capacity);
+    if(input.data == NULL){
+      printf("Memory allocation failed\n");
+      exit(1);
+    }
+  }
+  memcpy(input.data + input.length, keys, len);
+  input.length += len;
+}
+
+int replayKey(void){
+  /***
+   * Handle the next key in the input buffer and draw a frame for it the way the main loop does, for keys put there
+   * with feedKeys(). ctrl+s is skipped so replaying keys never writes a file. Returns 0 once the keys run out
+   * or ctrl+c is reached, the keys left over are dropped
+   */
+  while(input.start < input.length){
+    int keyLen = keyLength(1);
+    char *key = input.data + input.start;
+    if(keyLen == 1 && key[0] == CTRL_KEY('c')) break;
+    input.start += keyLen;
+    if(keyLen == 1 && key[0] == CTRL_KEY('s')) continue;
+    profilePhase(PHASE_EDIT);
+    handleKey(key, keyLen);
+    syncMappedRows();
+    if(searchFlag && search.uncounted) searchInBackground();
+    writeScreen();
+    return 1;
+  }
+  input.start = input.length = 0;
+  return 0;
+}
+
+int waitForEvents(int timeout){
+  /***
+   * Wait up to timeout milliseconds(-1 for as long as it takes) for input or the window changing size. Whatever the
+   * terminal has sent is read into the input buffer, returns 1 if any was
+   */
+  struct pollfd fds[2] = {{STDIN_FILENO, POLLIN, 0}, {loop.resizePipe[0], POLLIN, 0}};
+  if(poll(fds, 2, timeout) <= 0) return 0; //timed out, or a signal came in
+  if(fds[1].revents & POLLIN){
+    char drain[64];
+    while(read(loop.resizePipe[0], drain, sizeof(drain)) > 0);
+    resizeEditor();
+  }
+  if(!(fds[0].revents & POLLIN)) return 0;
+  profilePhase(PHASE_INPUT);
+  if(input.start > 0){ //move what's left to the front to make room
+    memmove(input.data, input.data + input.start, input.length - input.start);
+    input.length -= input.start;
+    input.start = 0;
+  }
+  if(input.capacity - input.length < (size_t)READ_CHUNK){
+    input.capacity = input.length + READ_CHUNK;
+    input.data = realloc(input.data, input.capacity);
+    if(input.data == NULL){
+      printf("Memory allocation failed\n");
+      exit(1);
+    }
+  }
+  ssize_t n = readTerminal(input.data + input.length, READ_CHUNK);
+  if(n <= 0) return 0;
+  input.length += n;
+  loop.lastInput = nowSeconds();
+  return 1;
+}
+
+int keyLength(int timedOut){
+  /***
+   * Returns how many bytes the next key in the input buffer is, or 0 if there isn't one yet. An escape sequence
+   * is a key once it's all in, and if the rest of it doesn't come in ESCAPE_WAIT(timedOut is 1) the escape is a key of its own
+   */
+  size_t n = input.length - input.start;
+  char *p = input.data + input.start;
+  if(n == 0) return 0;
+  if(p[0] != '\x1b') return 1;
+  if(n == 1) return timedOut;
+  if(p[1] == '['){ //CSI sequence, parameters and then a final byte from @ to ~
+    for(size_t i = 2; i < n && i < 32; i++){
+      if(p[i] >= 0x40 && p[i] <= 0x7e) return i + 1;
+    }
+    return n >= 32 || timedOut; //a sequence that never ends is just an escape and whatever came after it
+  }
+  if(p[1] == 'O') return n >= 3 ? 3 : timedOut; //SS3 sequence, some terminals send the arrow keys as these
+  return 1;
+}
+
+void handleKey(char *key, int len){
+  /***
+   * Do what a key says, key is len bytes long and is either one byte or a whole escape sequence
+   */
+  if(len == 1 && key[0] == CTRL_KEY('c')){
+    loop.quit = 1;
+    return;
+  }
+  applySearchResults(); //so a jump can reach the matches found while waiting for the key
+  if(prompt.active){
+    if(len == 1){
+      promptKeypress(key[0]);
+    } else if(len == 6 && memcmp(key, "\x1b[200~", 6) == 0){
+      promptPaste();
+    }
+  } else if(len == 1 && key[0] != '\x1b'){
+    sortKeypress(key[0]);
+  } else {
+    sortEscapes(key, len);
+  }
+  scrollCheck();
+  sidescrollCheck();
+}
+
+int processInput(int timedOut){
+  /***
+   * Handle every whole key in the input buffer, returns how many there were
+   */
+  int keys = 0;
+  int len;
+  while(!loop.quit && (len = keyLength(timedOut)) > 0){
+    char *key = input.data + input.start;
+    input.start += len;
+    keys++;
+    handleKey(key, len);
+  }
+  if(input.start == input.length) input.start = input.length = 0;
+  if(keys > 0){
+    loop.keys += keys;
+    loop.batches++;
+  }
+  return keys;
+}
+
+char* readPaste(int *len){
+  /***
+   * Read the text of a paste, everything up to the \x1b[201~ the terminal ends it with. The text is read READ_CHUNK
+   * bytes at a time instead of a byte at a time, whatever comes after the end is put back in the input buffer
+   */
+  size_t capacity = READ_CHUNK + (input.length - input.start);
+  size_t length = input.length - input.start;
+  char *text = malloc(capacity);
+  if(text == NULL){
+    printf("Memory allocation failed\n");
+    exit(1);
+  }
+  memcpy(text, input.data + input.start, length); //bytes read ahead of time are the first part of the paste
+  input.start = input.length = 0;
+  size_t scanned = 0; //the end sequence isn't anywhere before this
+  size_t end = 0;
+  int found = 0;
+  while(1){
+    for(char *esc = memchr(text + scanned, '\x1b', length - scanned); esc != NULL;
+        esc = memchr(esc + 1, '\x1b', text + length - esc - 1)){
+      if((size_t)(text + length - esc) < 6) break; //the end sequence may be cut off, look again once there's more
+      if(memcmp(esc, "\x1b[201~", 6) == 0){
+        end = esc - text;
+        found = 1;
+        break;
+      }
+    }
+    if(found) break;
+    scanned = length > 5 ? length - 5 : 0;
+    struct pollfd fd = {STDIN_FILENO, POLLIN, 0};
+    if(poll(&fd, 1, PASTE_WAIT) <= 0) break; //the terminal never ended the paste, take what there is
+    if(capacity - length < (size_t)READ_CHUNK){
+      capacity = capacity * 2 > length + READ_CHUNK ? capacity * 2 : length + READ_CHUNK;
+      text = realloc(text, capacity);
+      if(text == NULL){
+        printf("Memory allocation failed\n");
+        exit(1);
+      }
+    }
+    ssize_t n = readTerminal(text + length, READ_CHUNK);
+    if(n <= 0) break;
+    length += n;
+  }
+  if(!found){
+    end = length;
+  } else if(end + 6 < length){ //keys typed after the paste
+    size_t rest = length - end - 6;
+    if(input.capacity < rest){
+      input.capacity = rest;
+      input.data = realloc(input.data, input.capacity);
+      if(input.data == NULL){
+        printf("Memory allocation failed\n");
+        exit(1);
+      }
+    }
+    memcpy(input.data, text + end + 6, rest);
+    input.length = rest;
+  }
+  *len = end;
+  return text;
+}
+
+void pasteText(void){
+  /***
+   * Insert a paste at the cursor in one go. Terminals send the line breaks of a paste as \r, they become rows, and the
+   * other control characters are dropped. The paste is a single edit that is undone in one step, and the screen
+   * is only drawn again once it's all in
+   */
+  int len;
+  char *text = readPaste(&len);
+  int kept = 0;
+  for(int i = 0; i < len; i++){
+    char c = text[i];
+    if(c == '\r'){
+      if(i + 1 < len && text[i + 1] == '\n') continue; //\r\n is one line break
+      c = '\n';
+    }
+    if(((unsigned char)c < 32 && c != '\n' && c != '\t') || c == 127) continue;
+    text[kept++] = c;
+  }
+  if(kept > 0){
+    struct nmm_edit paste = {E.Cy-1, E.Cx-1, 0, text, kept};
+    int endRow, endCol;
+    applyEdits(&paste, 1, &endRow, &endCol); //typing after a paste is a new edit
+    moveCursorTo(endRow, endCol, endCol);
+  }
+  free(text);
+}
+
+void promptPaste(void){
+  /***
+   * Add the printable characters of a paste to the prompt's query, a search query is searched for once
+   */
+  int len;
+  char *text = readPaste(&len);
+  for(int i = 0; i < len && prompt.length < (int)sizeof(prompt.query) - 1; i++){
+    if(text[i] >= 32 && text[i] < 127) prompt.query[prompt.length++] = text[i];
+  }
+  prompt.query[prompt.length] = '\0';
+  free(text);
+  promptChanged();
+}
+
+/*** Visible Output ***/
+void cursor_move_cmd(void){ 
+  /***
+   * Write the commands to STDOUT to make the visual change of moving the cursor to the location specified by
+   * the global editor object E
+   */
+  char buf[32];
+  add_cmd("\x1b[?25l", 0); //make cursor invisible
+  snprintf(buf, sizeof(buf), "\x1b[%d;%dH", E.Cy-E.scroll, E.Cx - E.sidescroll);
+  add_cmd(buf, 0); //move cursor to location specified by Cx and Cy
+  grid.cursorY = E.Cy-E.scroll-1; //so the next frame doesn't think the cursor is still where its last cell was written
+  grid.cursorX = E.Cx-E.sidescroll-1;
+  add_cmd("\x1b[?25h", 0); //make cursor visible
+}
+
+void freeEditor(void){
+  /***
+   * Free every buffer and everything else the editor holds, done when it's closed. It can be opened again after this
+   */
+  freeBuffer();
+  for(int i = 0; i < buffers.numBuffers; i++){
+    if(i == buffers.current) continue;
+    restoreBuffer(&buffers.buffers[i]);
+    freeBuffer();
+  }
+  free(buffers.buffers);
+  memset(&buffers, 0, sizeof(buffers));
+  freeLanguages();
+  free(cbuf.cmds);
+  free(input.data);
+  free(grid.front);
+  free(grid.back);
+  closeTrace();
+  arena.needed = 0;
+  resetArena(); //frees the blocks the last frame overflowed into
+  free(arena.base);
+  memset(&input, 0, sizeof(input));
+  memset(&arena, 0, sizeof(arena));
+}
+
+void clearScreen(void){
+  /***
+   * Clear the whole terminal and forget what the grid thinks is on it, so the next frame is drawn from
+   * scratch. Used at startup and after anything else wrote to the terminal(like the echo of a prompt)
+   */
+  add_cmd("\x1b[0m\x1b[2J\x1b[H", 0); //reset colors, clear the screen and move to the top left, sent with the next frame
+  for(int i = 0; i < grid.rows * grid.cols; i++){
+    grid.front[i].ch = ' ';
+    grid.front[i].fg = DEFAULT_COLOR;
+    grid.front[i].bg = DEFAULT_COLOR;
+  }
+  grid.cursorX = 0;
+  grid.cursorY = 0;
+  grid.fg = DEFAULT_COLOR;
+  grid.bg = DEFAULT_COLOR;
+}
+
+/*** Frame Arena ***/
+void* arenaAlloc(size_t size){
+  /***
+   * Hand out size bytes of scratch memory that stay good until the next frame starts
+   */
+  size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+  arena.needed += size;
+  if(arena.used + size <= arena.capacity){
+    void *memory = arena.base + arena.used;
+    arena.used += size;
+    return memory;
+  }
+  char *block = malloc(ARENA_ALIGN + size); //doesn't fit this frame, the next one will have room for it
+  if(block == NULL){
+    printf("Memory allocation failed\n");
+    exit(1);
+  }
+  *(char **)block = arena.overflow;
+  arena.overflow = block;
+  return block + ARENA_ALIGN;
+}
+
+void resetArena(void){
+  /***
+   * Take back everything the last frame was handed, done once at the start of every frame. If the last frame
+   * needed more than the arena holds it is grown to fit, so a frame only allocates when it needs more than any before it
+   */
+  while(arena.overflow != NULL){
+    char *next = *(char **)arena.overflow;
+    free(arena.overflow);
+    arena.overflow = next;
+  }
+  if(arena.needed > arena.capacity){
+    size_t capacity = arena.capacity > 0 ? arena.capacity : MIN_ARENA;
+    while(capacity < arena.needed) capacity *= 2;
+    free(arena.base);
+    if(posix_memalign((void **)&arena.base, ARENA_ALIGN, capacity) != 0){
+      printf("Memory allocation failed\n");
+      exit(1);
+    }
+    arena.capacity = capacity;
+  }
+  arena.used = 0;
+  arena.needed = 0;
+}
+
+/*** Screen Grid ***/
+void initGrid(void){
+  /***
+   * Allocate the front and back buffers to fit the window plus the status bar row
+   */
+  grid.rows = E.w.ws_row + 1;
+  grid.cols = E.w.ws_col;
+  grid.front = malloc(sizeof(cell) * grid.rows * grid.cols);
+  grid.back = malloc(sizeof(cell) * grid.rows * grid.cols);
+  if(grid.front == NULL || grid.back == NULL){
+    printf("Memory allocation failed\n");
+    exit(1);
+  }
+  clearGrid();
+  clearScreen();
+}
+
+void clearGrid(void){
+  /***
+   * Blank out the back buffer before a frame is drawn into it
+   */
+  for(int i = 0; i < grid.rows * grid.cols; i++){
+    grid.back[i].ch = ' ';
+    grid.back[i].fg = DEFAULT_COLOR;
+    grid.back[i].bg = DEFAULT_COLOR;
+  }
+}
+
+char cellChar(char c){
+  /***
+   * The character a cell shows for c, control characters would move the terminal's cursor so they are shown as ?
+   */
+  if(c == '\t') return ' ';
+  if((unsigned char)c < 32 || c == 127) return '?';
+  return c;
+}
+
+int paintString(int y, int x, char *chars){
+  /***
+   * Paint chars into row y of the back buffer starting at column x. The color escape codes the
+   * highlighters insert(\x1b[38;5;Nm, \x1b[48;5;Nm and \x1b[0m) set the colors of the cells that
+   * follow instead of being painted. Returns the column after the last cell painted
+   */
+  if(chars == NULL || y < 0 || y >= grid.rows) return x;
+  short fg = DEFAULT_COLOR;
+  short bg = DEFAULT_COLOR;
+  for(char *p = chars; *p != '\0'; p++){
+    if(*p == '\x1b' && p[1] == '['){ //color escape code
+      p += 2;
+      int params[8];
+      int numParams = 0;
+      while(*p != '\0' && *p != 'm'){
+        if(numParams < 8) params[numParams++] = strtol(p, &p, 10);
+        if(*p == ';') p++;
+        else if(*p != 'm' && *p != '\0') p++; //skip anything that isn't a number
+      }
+      if(numParams == 0 || params[0] == 0){
+        fg = DEFAULT_COLOR;
+        bg = DEFAULT_COLOR;
+      } else if(numParams >= 3 && params[0] == 38 && params[1] == 5){
+        fg = params[2];
+      } else if(numParams >= 3 && params[0] == 48 && params[1] == 5){
+        bg = params[2];
+      }
+      if(*p == '\0') break;
+      continue;
+    }
+    if(x >= 0 && x < grid.cols){
+      cell *c = &grid.back[y * grid.cols + x];
+      c->ch = cellChar(*p);
+      c->fg = fg;
+      c->bg = bg;
+    }
+    x++;
+  }
+  return x;
+}
+
+int cellsEqual(cell *a, cell *b){
+  return a->ch == b->ch && a->fg == b->fg && a->bg == b->bg;
+}
+
+int isBlankCell(cell *c){
+  return c->ch == ' ' && c->fg == DEFAULT_COLOR && c->bg == DEFAULT_COLOR;
+}
+
+void gridSetColors(short fg, short bg){
+  /***
+   * Add the escape codes to switch the terminal to fg and bg, if it isn't using them already
+   */
+  if(fg == grid.fg && bg == grid.bg) return;
+  char buf[48];
+  int len = snprintf(buf, sizeof(buf), "\x1b[0m");
+  if(fg != DEFAULT_COLOR) len += snprintf(buf + len, sizeof(buf) - len, "\x1b[38;5;%dm", fg);
+  if(bg != DEFAULT_COLOR) len += snprintf(buf + len, sizeof(buf) - len, "\x1b[48;5;%dm", bg);
+  add_cmd(buf, 0);
+  grid.fg = fg;
+  grid.bg = bg;
+}
+
+void gridPutCell(int y, int x){
+  /***
+   * Write the back buffer's cell at x, y to the terminal, the cursor must already be there
+   */
+  cell *c = &grid.back[y * grid.cols + x];
+  char ch[2] = {c->ch, '\0'};
+  gridSetColors(c->fg, c->bg);
+  add_cmd(ch, 0);
+  grid.front[y * grid.cols + x] = *c;
+  grid.cursorX = x + 1;
+  if(grid.cursorX >= grid.cols) grid.cursorX = -1; //the terminal may be waiting to wrap, don't trust its position
+}
+
+void gridMoveTo(int y, int x){
+  /***
+   * Move the terminal's cursor to x, y, a short hop to the right along the same row is done by
+   * rewriting the cells in between since that is shorter than a cursor move command
+   */
+  if(grid.cursorY == y && grid.cursorX == x) return;
+  if(grid.cursorY == y && grid.cursorX >= 0 && x > grid.cursorX && x - grid.cursorX <= MAX_SKIP_REWRITE){
+    while(grid.cursorX >= 0 && grid.cursorX < x) gridPutCell(y, grid.cursorX);
+    if(grid.cursorX == x) return;
+  }
+  char buf[32];
+  snprintf(buf, sizeof(buf), "\x1b[%d;%dH", y + 1, x + 1);
+  add_cmd(buf, 0);
+  grid.cursorX = x;
+  grid.cursorY = y;
+}
+
+int rowHasHighBytes(cell *cells, int cols){
+  /***
+   * Check if a row of cells has bytes of multi-byte characters in it
+   */
+  for(int x = 0; x < cols; x++){
+    if((unsigned char)cells[x].ch >= 128) return 1;
+  }
+  return 0;
+}
+
+void flushGrid(void){
+  /***
+   * Send the cells of the back buffer that differ from the front buffer to the terminal and make the
+   * front buffer match. Rows that end in blank cells are cut short with an erase to end of line
+   */
+  add_cmd("\x1b[?25l", 0); //hide the cursor while drawing
+  for(int y = 0; y < grid.rows; y++){
+    cell *back = &grid.back[y * grid.cols];
+    cell *front = &grid.front[y * grid.cols];
+    if(memcmp(back, front, sizeof(cell) * grid.cols) == 0) continue;
+
+    int last = grid.cols - 1; //last cell of the row that isn't blank
+    while(last >= 0 && isBlankCell(&back[last])) last--;
+    //a multi-byte character takes up one column for several cells, so the cell positions of these
+    //rows can't be trusted and the whole row is written out again
+    int whole = rowHasHighBytes(back, grid.cols) || rowHasHighBytes(front, grid.cols);
+    for(int x = 0; x < grid.cols; x++){
+      if(!whole && cellsEqual(&back[x], &front[x])) continue;
+      if(x > last){ //the rest of the row is blank
+        gridMoveTo(y, x);
+        gridSetColors(DEFAULT_COLOR, DEFAULT_COLOR);
+        add_cmd("\x1b[K", 0); //erase to the end of the line
+        memcpy(&front[x], &back[x], sizeof(cell) * (grid.cols - x));
+        break;
+      }
+      gridMoveTo(y, x);
+      gridPutCell(y, x);
+    }
+    if(whole) grid.cursorX = -1;
+  }
+  gridSetColors(DEFAULT_COLOR, DEFAULT_COLOR);
+}
+
+/*** Highlight Cache ***/
+void initHighlightCache(void){
+  /***
+   * Make room in the highlight cache for a few screens worth of rows
+   */
+  int capacity = 64;
+  while(capacity < 4 * (E.w.ws_row + 1)) capacity *= 2;
+  hlCache.entries = calloc(capacity, sizeof(struct highlight_entry));
+  if(hlCache.entries == NULL){
+    printf("Memory allocation failed\n");
+    exit(1);
+  }
+  hlCache.capacity = capacity;
+}
+
+void clearHighlightCache(void){
+  /***
+   * Forget every cached row
+   */
+  for(int i = 0; i < hlCache.capacity; i++){
+    free(hlCache.entries[i].cells);
+    memset(&hlCache.entries[i], 0, sizeof(struct highlight_entry));
+  }
+}
+
+cell* highlightRow(row *r, int multiline, int *numCells){
+  /***
+   * Returns the visible cells of a row with its comments, keywords, and search matches colored, and sets
+   * numCells to how many there are. The cells are reused from the last frame that drew this row unless
+   * the row, the side scroll, the window width, the search, or the row's multiline comment state changed.
+   * The cache owns the returned cells
+   */
+  unsigned int search = searchFlag ? hlCache.searchStamp : 0;
+  size_t hash = ((size_t)r >> 4) * 2654435761u;
+  struct highlight_entry *entry = &hlCache.entries[hash & (hlCache.capacity - 1)];
+  if(entry->owner == r && entry->version == r->version && entry->sidescroll == E.sidescroll &&
+      entry->cols == E.w.ws_col && entry->multiline == multiline && entry->search == search){
+    hlCache.hits++;
+    *numCells = entry->numCells;
+    return entry->cells;
+  }
+  hlCache.misses++;
+
+  //the spans are found over the whole row so a comment or match that starts left of the screen still shows, the text
+  //is read right where the row keeps it unless the row's gap is in the middle of it
+  char *text = searchRowText(r);
+  hl.numSpans = 0;
+  int commented = inlineCommentHighlight(text); //the index at which a // occurs if it does
+  int visibleEnd = E.sidescroll + E.w.ws_col; //keywords past the right edge of the window aren't drawn
+  if(multiline == 0) highlightSyntax(text, commented < visibleEnd ? commented : visibleEnd);
+  if(multiline) multilineCommentHighlight(text);
+  if(searchFlag) searchHighlight(text);
+
+  int count = r->length - E.sidescroll;
+  if(count > E.w.ws_col) count = E.w.ws_col; //clip the row to the width of the window
+  if(count < 0) count = 0;
+  if(count > entry->capacity){
+    free(entry->cells);
+    entry->cells = malloc(sizeof(cell) * count);
+    if(entry->cells == NULL){
+      printf("Memory allocation failed\n");
+      exit(1);
+    }
+    entry->capacity = count;
+  }
+  emitSpans(entry->cells, text, E.sidescroll, count);
+
+  entry->owner = r;
+  entry->version = r->version;
+  entry->sidescroll = E.sidescroll;
+  entry->cols = E.w.ws_col;
+  entry->multiline = multiline;
+  entry->search = search;
+  entry->numCells = count;
+  *numCells = count;
+  return entry->cells;
+}
+
+void writeScreen(void){
+  /***
+   * This will draw each visible row within the global editor object's rows into the screen grid, account for comments,
+   * syntax highlighting, and search highlighting, and then send whatever changed since the last frame to the terminal
+   */
+  profilePhase(PHASE_HIGHLIGHT);
+  resetArena(); //nothing from the last frame is needed anymore
+  int lastRow = E.numrows < E.scroll + E.w.ws_row ? E.numrows : E.scroll + E.w.ws_row;
+  for(int i = E.scroll; i < lastRow; i++) rowAt(i); //load the visible lines of a mapped file before their comments are looked at
+  int *markedRows;
+  markedRows = markMultilineRows(E.scroll, E.w.ws_row); //mark the visible rows highlighted by a multiline comment
+  clearGrid();
+  for(int i = E.scroll; i < lastRow; i++){
+    int numCells;
+    cell *cells = highlightRow(rowAt(i), markedRows[i - E.scroll], &numCells);
+    memcpy(&grid.back[(i - E.scroll) * grid.cols], cells, sizeof(cell) * numCells);
+  }
+  profilePhase(PHASE_COMPOSE);
+  paintString(E.w.ws_row, 0, statusMessage);
+  printCursorPos();
+  if(searchFlag) printSearchCount();
+  scrollCheck();
+  sidescrollCheck();
+  flushGrid();
+  if(prompt.active){ //the cursor waits at the end of the query being typed instead of in the text
+    int x = E.Cx;
+    int y = E.Cy;
+    int end = strlen(prompt.label) + prompt.length;
+    E.Cy = E.w.ws_row + E.scroll + 1;
+    E.Cx = E.sidescroll + (end < grid.cols ? end : grid.cols - 1) + 1;
+    cursor_move_cmd();
+    E.Cx = x;
+    E.Cy = y;
+  } else {
+    cursor_move_cmd(); //move cursor to current cursor position(visible change)
+  }
+  profilePhase(PHASE_WRITE);
+  writeCmds(); //send the whole frame in one go
+  endFrame();
+}
+
+/*** Newline Scanning ***/
+void lineTableReserve(struct line_table *table, size_t needed){
+  /***
+   * Make sure a line table has room for needed more offsets
+   */
+  if(table->count + needed <= table->capacity) return;
+  size_t capacity = table->capacity;
+  while(capacity < table->count + needed) capacity = GROW_CAPACITY(capacity);
+  table->offsets = realloc(table->offsets, sizeof(size_t) * capacity);
+  if(table->offsets == NULL){
+    printf("Memory allocation failed\n");
+    exit(1);
+  }
+  table->capacity = capacity;
+}
+
+void scanNewlinesScalar(const char *buf, size_t len, size_t base, struct line_table *table){
+  /***
+   * Plain memchr version of scanNewlines for machines without SSE2 or AVX2
+   */
+  const char *p = buf;
+  const char *end = buf + len;
+  while((p = memchr(p, '\n', end - p)) != NULL){
+    lineTableReserve(table, 1);
+    table->offsets[table->count++] = base + (p - buf);
+    p++;
+  }
+}
+
+#ifdef HAVE_X86_SIMD
+void scanNewlinesSSE2(const char *buf, size_t len, size_t base, struct line_table *table){
+  /***
+   * SSE2 version of scanNewlines, compares 16 bytes at a time and walks the bits of the match mask
+   */
+  __m128i newline = _mm_set1_epi8('\n');
+  size_t i = 0;
+  for(; i + 16 <= len; i += 16){
+    unsigned int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(buf + i)), newline));
+    if(mask == 0) continue;
+    lineTableReserve(table, 16);
+    while(mask != 0){
+      table->offsets[table->count++] = base + i + __builtin_ctz(mask);
+      mask &= mask - 1; //clear the lowest set bit
+    }
+  }
+  scanNewlinesScalar(buf + i, len - i, base + i, table);
+}
+
+__attribute__((target("avx2")))
+void scanNewlinesAVX2(const char *buf, size_t len, size_t base, struct line_table *table){
+  /***
+   * AVX2 version of scanNewlines, compares 32 bytes at a time
+   */
+  __m256i newline = _mm256_set1_epi8('\n');
+  size_t i = 0;
+  for(; i + 32 <= len; i += 32){
+    unsigned int mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(buf + i)), newline));
+    if(mask == 0) continue;
+    lineTableReserve(table, 32);
+    while(mask != 0){
+      table->offsets[table->count++] = base + i + __builtin_ctz(mask);
+      mask &= mask - 1;
+    }
+  }
+  scanNewlinesScalar(buf + i, len - i, base + i, table);
+}
+#endif
+
+void scanNewlines(const char *buf, size_t len, size_t base, struct line_table *table){
+  /***
+   * Append the offset(plus base) of every \n in the first len bytes of buf to table, this picks the
+   * widest vector instructions the CPU supports
+   */
+#ifdef HAVE_X86_SIMD
+  static int hasAVX2 = -1;
+  if(hasAVX2 == -1) hasAVX2 = __builtin_cpu_supports("avx2");
+  if(hasAVX2){
+    scanNewlinesAVX2(buf, len, base, table);
+  } else {
+    scanNewlinesSSE2(buf, len, base, table);
+  }
+#else
+  scanNewlinesScalar(buf, len, base, table);
+#endif
+}
+
+size_t countNewlines(const char *buf, size_t len){
+  /***
+   * Returns how many \n there are in the first len bytes of buf
+   */
+  struct line_table table = {NULL, 0, 0};
+  scanNewlines(buf, len, 0, &table);
+  free(table.offsets);
+  return table.count;
+}
+
+/*** File IO ***/
+void readFile(char *filename) {
+  /***
+   * Read a file into the global editor object E
+   */
+  if(strlen(filename) > 256){
+    printf("%s\n", "File name too large");
+    return;
+  }
+  CURRENT_FILENAME = filename; //CURRENT_FILENAME points to same block of memory as *filename which is argv[1]
+
+  struct stat st;
+  if(stat(filename, &st) == 0 && st.st_size >= MMAP_THRESHOLD && openMappedFile(filename, &st) == 0){
+    E.savedChanges = E.changes; //the rows loading made are what's on disk
+    return; //big files are mapped and loaded lazily instead of being read in
+  }
+
+  if(loadFileBlocks(filename) == -1){
+    perror("Error opening file");
+  }
+  E.savedChanges = E.changes;
+  commentsChanged(0); //none of the rows that were read in have their multiline comment state yet
+  commentsChanged(E.numrows - 1);
+}
+
+char* readWholeFile(char *filename, size_t *size){
+  /***
+   * Read a whole file into one buffer using LOAD_BLOCK sized reads, returns NULL if it can't be read
+   */
+  int fd = open(filename, O_RDONLY);
+  if(fd == -1) return NULL;
+  struct stat st;
+  if(fstat(fd, &st) == -1){
+    close(fd);
+    return NULL;
+  }
+  char *buf = malloc(st.st_size + 1); //+1 so an empty file still gets a buffer
+  if(buf == NULL){
+    close(fd);
+    return NULL;
+  }
+  size_t total = 0;
+  while(total < (size_t)st.st_size){
+    size_t want = st.st_size - total;
+    if(want > (size_t)LOAD_BLOCK) want = LOAD_BLOCK;
+    ssize_t got = read(fd, buf + total, want);
+    if(got == -1 && errno == EINTR) continue;
+    if(got <= 0) break; //the file got shorter while we were reading it
+    total += got;
+  }
+  close(fd);
+  *size = total;
+  return buf;
+}
+
+void* scanLoadChunk(void *arg){
+  /***
+   * Runs on a loader thread, finds the newlines in this thread's part of the file
+   */
+  struct load_chunk *chunk = arg;
+  scanNewlines(chunk->buf + chunk->start, chunk->end - chunk->start, chunk->start, &chunk->newlines);
+  return NULL;
+}
+
+void* buildLoadChunk(void *arg){
+  /***
+   * Runs on a loader thread, copies every line that ends in this thread's part of the file into its row
+   */
+  struct load_chunk *chunk = arg;
+  size_t lineStart = chunk->lineStart;
+  for(size_t i = 0; i < chunk->newlines.count; i++){
+    size_t lineEnd = chunk->newlines.offsets[i];
+    chunk->nodes[i].r.chars = NULL;
+    chunk->nodes[i].r.version = 0;
+    chunk->nodes[i].matches = 0;
+    chunk->nodes[i].searched = 0;
+    chunk->nodes[i].r.snapshot = 0;
+    chunk->nodes[i].born = 0;
+    chunk->nodes[i].lines = 1;
+    setChars(&chunk->nodes[i].r, chunk->buf + lineStart, lineEnd - lineStart);
+    lineStart = lineEnd + 1;
+  }
+  return NULL;
+}
+
+int loadFileBlocks(char *filename){
+  /***
+   * Read a file into the global editor object E. The file is read in big blocks and split into one
+   * chunk per core, every chunk is scanned for newlines in parallel, and the per chunk newline tables
+   * are then merged so every row node can be allocated at once and the rows filled in parallel
+   */
+  size_t size;
+  char *buf = readWholeFile(filename, &size);
+  if(buf == NULL) return -1;
+
+  long cores = sysconf(_SC_NPROCESSORS_ONLN);
+  int numChunks = cores < 1 ? 1 : (cores > MAX_LOAD_THREADS ? MAX_LOAD_THREADS : cores);
+  if((size_t)numChunks > size / MIN_LOAD_CHUNK) numChunks = size / MIN_LOAD_CHUNK;
+  if(numChunks < 1) numChunks = 1;
+
+  struct load_chunk chunks[MAX_LOAD_THREADS];
+  memset(chunks, 0, sizeof(chunks));
+  for(int i = 0; i < numChunks; i++){
+    chunks[i].buf = buf;
+    chunks[i].start = size / numChunks * i;
+    chunks[i].end = i == numChunks - 1 ? size : size / numChunks * (i + 1);
+    if(i > 0) chunks[i].threaded = pthread_create(&chunks[i].thread, NULL, scanLoadChunk, &chunks[i]) == 0;
+  }
+  for(int i = 0; i < numChunks; i++){ //the main thread takes the first chunk itself, and any that didn't get a thread
+    if(!chunks[i].threaded) scanLoadChunk(&chunks[i]);
+  }
+  for(int i = 1; i < numChunks; i++){
+    if(chunks[i].threaded) pthread_join(chunks[i].thread, NULL);
+  }
+
+  //merge the newline tables, every newline ends one row and the text after the last one is the final row
+  size_t numLines = 1;
+  for(int i = 0; i < numChunks; i++) numLines += chunks[i].newlines.count;
+  rownode *nodes = reserveRowNodes(numLines);
+  size_t firstLine = 0;
+  size_t lineStart = 0;
+  for(int i = 0; i < numChunks; i++){
+    chunks[i].nodes = nodes + firstLine;
+    chunks[i].lineStart = lineStart;
+    firstLine += chunks[i].newlines.count;
+    if(chunks[i].newlines.count > 0) lineStart = chunks[i].newlines.offsets[chunks[i].newlines.count - 1] + 1;
+  }
+
+  for(int i = 1; i < numChunks; i++){
+    chunks[i].threaded = pthread_create(&chunks[i].thread, NULL, buildLoadChunk, &chunks[i]) == 0;
+  }
+  for(int i = 0; i < numChunks; i++){
+    if(!chunks[i].threaded) buildLoadChunk(&chunks[i]);
+  }
+  nodes[numLines - 1].r.chars = NULL;
+  nodes[numLines - 1].r.version = 0;
+  nodes[numLines - 1].matches = 0;
+  nodes[numLines - 1].searched = 0;
+  nodes[numLines - 1].r.snapshot = 0;
+  nodes[numLines - 1].born = 0;
+  nodes[numLines - 1].lines = 1;
+  setChars(&nodes[numLines - 1].r, buf + lineStart, size - lineStart);
+  for(int i = 1; i < numChunks; i++){
+    if(chunks[i].threaded) pthread_join(chunks[i].thread, NULL);
+  }
+
+  for(int i = 0; i < numChunks; i++) free(chunks[i].newlines.offsets);
+  free(buf);
+
+  deleteRowAt(0); //drop the empty row initEditor made
+  int height;
+  E.rows = buildRowTree(nodes, numLines, &height);
+  E.numrows = numLines;
+  return 0;
+}
+
+double nowSeconds(void){
+  /***
+   * Monotonic clock in seconds, used for timing
+   */
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int loadRows(char *filename){
+  /***
+   * Read filename into the rows with the block loader even if it's big enough to be mapped, so the loader can be
+   * timed on its own. There can't be any rows yet, free_all_rows() frees them again. Returns the number of rows,
+   * or -1 if the file couldn't be read
+   */
+  appendRow(); //loadFileBlocks replaces the usual first empty row
+  if(loadFileBlocks(filename) == -1) return -1;
+  return E.numrows;
+}
+
+int openMappedFile(char *filename, struct stat *st){
+  /***
+   * Memory map a big file and start indexing its lines in the background, this only waits until the
+   * first INDEX_STRIDE lines are indexed so the first screen can be drawn right away. Returns -1 if
+   * the file couldn't be mapped, in which case it should be read in normally
+   */
+  int fd = open(filename, O_RDONLY);
+  if(fd == -1) return -1;
+  char *data = mmap(NULL, st->st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd); //the mapping stays valid after the file is closed
+  if(data == MAP_FAILED) return -1;
+
+  mapped.data = data;
+  mapped.size = st->st_size;
+  mapped.synced = 0;
+  mapped.finished = 0;
+  struct line_index *index = malloc(sizeof(struct line_index));
+  if(index == NULL){
+    printf("Memory allocation failed\n");
+    exit(1);
+  }
+  index->data = data;
+  index->size = mapped.size;
+  index->capLineStarts = 1024;
+  index->lineStarts = malloc(sizeof(size_t) * index->capLineStarts);
+  index->lineStarts[0] = 0; //the first line starts at the beginning of the file
+  index->numLineStarts = 1;
+  index->totalLines = 0;
+  index->done = 0;
+  index->cancel = 0;
+  pthread_mutex_init(&index->lock, NULL);
+  pthread_cond_init(&index->cond, NULL);
+  mapped.index = index;
+  pthread_create(&mapped.indexer, NULL, indexMappedFile, index);
+
+  pthread_mutex_lock(&index->lock);
+  while(index->numLineStarts < 2 && !index->done){ //wait for the first span of lines
+    pthread_cond_wait(&index->cond, &index->lock);
+  }
+  pthread_mutex_unlock(&index->lock);
 
-    int copy_length = E.rows[cy-1].length - (E.Cx-1) + 1; //the length of how much of the string to move to the next row down
+  deleteRowAt(0); //drop the empty row initEditor made, the spans replace it
+  syncMappedRows();
+  return 0;
+}
 
-    shiftRowsDown(cy-1);
+void* indexMappedFile(void *arg){
+  /***
+   * Runs on the indexer thread, records where every INDEX_STRIDE'th line of the mapped file starts.
+   * Pages that have been scanned are dropped again so indexing doesn't keep the whole file in memory
+   */
+  struct line_index *index = arg; //not mapped, the buffer may be switched away from while this runs
+  struct line_table block = {NULL, 0, 0}; //newlines of the block being scanned
+  size_t released = 0;
+  int lines = 0;
+  for(size_t start = 0; start < index->size; start += SCAN_BLOCK){
+    pthread_mutex_lock(&index->lock);
+    int cancel = index->cancel;
+    pthread_mutex_unlock(&index->lock);
+    if(cancel) break; //the file is being closed, nobody is waiting for the rest
+    size_t len = index->size - start < (size_t)SCAN_BLOCK ? index->size - start : (size_t)SCAN_BLOCK;
+    block.count = 0;
+    scanNewlines(index->data + start, len, start, &block);
+    for(size_t i = 0; i < block.count; i++){
+      lines++;
+      if(lines % INDEX_STRIDE == 0){
+        pthread_mutex_lock(&index->lock);
+        if(index->numLineStarts == index->capLineStarts){
+          index->capLineStarts = GROW_CAPACITY(index->capLineStarts);
+          index->lineStarts = realloc(index->lineStarts, sizeof(size_t) * index->capLineStarts);
+        }
+        index->lineStarts[index->numLineStarts++] = block.offsets[i] + 1; //the next line starts after the \n
+        pthread_cond_signal(&index->cond);
+        pthread_mutex_unlock(&index->lock);
+      }
+    }
+    if(start + len - released >= (size_t)INDEX_RELEASE){
+      madvise(index->data + released, INDEX_RELEASE, MADV_DONTNEED);
+      released += INDEX_RELEASE;
+    }
+  }
+  free(block.offsets);
+  pthread_mutex_lock(&index->lock);
+  index->totalLines = lines + 1; //the last line doesn't end with a \n
+  index->done = 1;
+  pthread_cond_signal(&index->cond);
+  pthread_mutex_unlock(&index->lock);
+  return NULL;
+}
 
-    memset(E.rows[cy].chars, 0, E.rows[cy].capacity);
-    E.rows[cy].chars[0] = '\0';
-    E.rows[cy].length = 0;
+void appendSpan(size_t start, size_t len, int lines){
+  /***
+   * Add an unloaded span of lines from the mapped file to the end of the rows
+   */
+  rownode *node = allocRowNode();
+  node->r.chars = NULL;
+  node->lines = lines;
+  node->spanStart = start;
+  node->spanLen = len;
+  insertNodeAt(E.numrows, node);
+  E.numrows += lines;
+  if(searchFlag) search.uncounted = 1; //left for a background search, the indexer can add a lot of text at once
+}
 
-    memcpy(E.rows[cy].chars, E.rows[cy-1].chars + E.Cx - 1, copy_length);
-    E.rows[cy].length = copy_length - 1;
+void syncMappedRows(void){
+  /***
+   * Add the lines the indexer has found since the last call to the end of the rows
+   */
+  if(mapped.data == NULL || mapped.finished) return;
+  struct line_index *index = mapped.index;
+  pthread_mutex_lock(&index->lock);
+  for(; mapped.synced + 1 < index->numLineStarts; mapped.synced++){
+    size_t start = index->lineStarts[mapped.synced];
+    appendSpan(start, index->lineStarts[mapped.synced + 1] - 1 - start, INDEX_STRIDE); //-1 to leave out the last \n
+  }
+  if(index->done){ //everything after the last recorded offset is the final span
+    size_t start = index->lineStarts[mapped.synced];
+    appendSpan(start, mapped.size - start, index->totalLines - mapped.synced * INDEX_STRIDE);
+    mapped.finished = 1;
+  }
+  pthread_mutex_unlock(&index->lock);
+  if(mapped.finished) endIndexer(); //it has nothing left to do once done is set
+}
 
-    E.rows[cy-1].chars[E.Cx-1] = '\0'; //cut off the current row at cursor position
-    E.rows[cy-1].length = E.Cx-1; //decrement the current row's length
-    incrementCursor(0,1,0,0); //move cursor down
-    
-  }else if (E.Cx-1 == 0){ //cursor at beginning of row, can be any row
-    appendRow();
-    shiftRowsDown(cy-1);
+void syncMappedRowsTo(int index){
+  /***
+   * Make sure the row at index is in the row tree if the file has one, waiting for the indexer only as long as it
+   * takes to get that far. Rows past the end of the file just wait for the indexer to finish
+   */
+  while(index >= E.numrows && mapped.data != NULL && !mapped.finished){
+    pthread_mutex_lock(&mapped.index->lock);
+    while(!mapped.index->done && mapped.index->numLineStarts <= mapped.synced + 1){ //nothing new to add yet
+      pthread_cond_wait(&mapped.index->cond, &mapped.index->lock);
+    }
+    pthread_mutex_unlock(&mapped.index->lock);
+    syncMappedRows();
+  }
+}
 
-    //reset current row to empty
-    memset(E.rows[cy-1].chars, 0, E.rows[cy-1].capacity);
-    E.rows[cy-1].chars[0] = '\0';
-    E.rows[cy-1].length = 0;
+void endIndexer(void){
+  /***
+   * Join the indexer thread and free what it used, the indexer has to be done or cancelled
+   */
+  pthread_join(mapped.indexer, NULL);
+  free(mapped.index->lineStarts);
+  pthread_mutex_destroy(&mapped.index->lock);
+  pthread_cond_destroy(&mapped.index->cond);
+  free(mapped.index);
+  mapped.index = NULL;
+}
 
-    incrementCursor(0,1,0,0); //move cursor down
+void finishMappedFile(void){
+  /***
+   * Wait for the indexer to finish and add all of the mapped file's lines to the rows
+   */
+  if(mapped.data == NULL || mapped.finished) return;
+  pthread_mutex_lock(&mapped.index->lock);
+  while(!mapped.index->done){
+    pthread_cond_wait(&mapped.index->cond, &mapped.index->lock);
   }
-  E.Cx = 1; //snap the cursor to the far left of the current row
-  E.sidescroll = 0; //set sidescroll to 0
+  pthread_mutex_unlock(&mapped.index->lock);
+  syncMappedRows();
 }
 
-void removeRow(int backSpace){
+void saveFile(void){
   /***
-   * Remove a row in response to the user pressing backspace or delete, this method handles copy and moving of characters
+   * Ask for the name to save the file under in the status bar, the keys typed go to the prompt until enter or
+   * escape like they do for a search. The cursor stays where it is
    */
-  if(backSpace){
-    if(E.rows[E.Cy-2].length != 0) E.Cx = E.rows[E.Cy-2].length + 1;
-    incrementCursor(1,0,0,0); //increment cursor u
-    int cy = E.Cy;
+  prompt.active = 1;
+  prompt.save = 1;
+  prompt.regex = 0;
+  prompt.label = "Filename: ";
+  prompt.query[0] = '\0';
+  prompt.length = 0;
+  prompt.error = NULL;
+  snprintf(statusMessage, sizeof(statusMessage), "%s", prompt.label);
+}
 
-    if(E.rows[cy-1].length + E.rows[cy].length + 1 >= (int)E.rows[cy-1].capacity){
-      E.rows[cy-1].chars = realloc(E.rows[cy-1].chars, E.rows[cy-1].capacity + E.rows[cy].length + 1);
-      E.rows[cy-1].capacity += E.rows[cy].length + 1;
-    }
+void closeSavePrompt(int save){
+  /***
+   * Close the filename prompt, saving under the name typed if save is 1. Enter on its own saves to the file that is
+   * open
+   */
+  prompt.active = 0;
+  prompt.save = 0;
+  statusMessage[0] = '\0';
+  if(!save) return;
+  if(prompt.length == 0 && CURRENT_FILENAME == NULL){
+    snprintf(statusMessage, sizeof(statusMessage), "Filename cannot be empty");
+    return;
+  }
+  writeFile(prompt.length > 0 ? prompt.query : CURRENT_FILENAME);
+}
 
-    memcpy(E.rows[cy-1].chars + E.rows[cy-1].length, E.rows[cy].chars, E.rows[cy].length + 1);
-    E.rows[cy-1].length += E.rows[cy].length;
+int writeFile(char *filename){
+  /***
+   * Start saving the rows to a file. The text is written to a temp file next to the file first, synced to disk, and
+   * then renamed over it, so the file is either the old text or the new text and never half of each even if the
+   * editor or the machine dies partway through. The writing is done by a worker thread from a snapshot of the rows,
+   * so the editor can be used while it runs, applySaveResult() reports how it went. Returns -1 with errno set if
+   * the save couldn't be started. Only statusMessage is set, the cursor stays where it is
+   */
+  waitForSave(); //one save at a time, the new one has the newer text
+  double start = nowSeconds();
 
-    memset(E.rows[cy].chars, 0, E.rows[cy].capacity);
-    E.rows[cy].chars[0] = '\0';
-    E.rows[cy].length = 0;
-    
-    shiftRowsUp(E.Cy); //shift all rows up one up to the row below the current row
-    deleteExistingRow(); //delete the bottom row
+  char *path = realpath(filename, NULL); //write to where a symlink points rather than replacing the link
+  if(path == NULL) path = strdup(filename); //the file doesn't exist yet
+  char *tmpname = malloc(strlen(path) + 8);
+  if(path == NULL || tmpname == NULL){
+    printf("Memory allocation failed\n");
+    exit(1);
+  }
+  sprintf(tmpname, "%s.XXXXXX", path);
+  int fd = mkstemp(tmpname); //the temp file has to be on the same filesystem for the rename, so it goes in the same directory
 
+  if(fd == -1){
+    int error = errno;
+    snprintf(statusMessage, sizeof(statusMessage), "Error opening file: %s", strerror(error));
+    free(tmpname);
+    free(path);
+    errno = error; //for nmmSave()
+    return -1;
+  }
+  struct stat st;
+  if(stat(path, &st) == 0){ //keep the old file's permissions and owner
+    fchmod(fd, st.st_mode & 07777);
+    if(fchown(fd, st.st_uid, st.st_gid) == -1){} //only works for root or the same owner, the file is still saved if it fails
   } else {
-    shiftRowsUp(E.Cy-1); //shift all rows up one up to the current row
-    deleteExistingRow(); //delete the bottom row
+    mode_t mask = umask(0); //mkstemp makes the file readable only by us, give it the permissions a new file would get
+    umask(mask);
+    fchmod(fd, 0666 & ~mask);
+  }
+
+  //the snapshot is just the tree's root, every node there is now is copied before it's changed while the save runs
+  saveJob->id = ++snapshots.lastId;
+  saveJob->root = E.rows;
+  saveJob->data = mapped.data;
+  saveJob->size = mapped.size;
+  saveJob->tail = mapped.size;
+  if(mapped.data != NULL && !mapped.finished){ //the lines the indexer has found since the last sync aren't in the tree
+    pthread_mutex_lock(&mapped.index->lock);
+    saveJob->tail = mapped.index->lineStarts[mapped.synced];
+    pthread_mutex_unlock(&mapped.index->lock);
+  }
+  saveJob->numPieces = 0;
+  saveJob->numRetired = 0;
+  saveJob->total = 0;
+  saveJob->fd = fd;
+  saveJob->path = path;
+  saveJob->tmpname = tmpname;
+  snprintf(saveJob->filename, sizeof(saveJob->filename), "%s", filename);
+  saveJob->changes = E.changes;
+  saveJob->ownFile = 0;
+  saveJob->adopt = NULL;
+  if(CURRENT_FILENAME == NULL){ //a new buffer is named by its first save
+    saveJob->adopt = strdup(filename);
+    if(saveJob->adopt == NULL){
+      printf("Memory allocation failed\n");
+      exit(1);
+    }
+  } else if(strcmp(CURRENT_FILENAME, filename) == 0){
+    saveJob->ownFile = 1;
+  } else { //the same file under another name, like a path through a symlink
+    char *own = realpath(CURRENT_FILENAME, NULL);
+    saveJob->ownFile = own != NULL && strcmp(own, path) == 0;
+    free(own);
   }
+  saveJob->start = start;
+  saveJob->written = 0;
+  saveJob->finished = 0;
+  saveJob->error = 0;
+  saveJob->running = 1;
+  pthread_create(&saveJob->thread, NULL, saveWorker, saveJob);
+  snprintf(statusMessage, sizeof(statusMessage), "Saving %s", filename);
+  return 0;
 }
 
-/*** Cursor Manipulation Methods ***/
-void printCursorPos(void){
+void addSavePiece(struct save_job *job, const char *text, size_t length, int newline){
   /***
-   * Print the current position of the cursor in the bottom right of the screen
+   * Add a piece of text to the list of what a save writes, runs on the save's thread
    */
-  int oldY = E.Cy;
-  int oldX = E.Cx;
-  int bufSize = snprintf(NULL, 0, "Ln %d, Col %d", E.Cy, E.Cx)+1;
-  char *buf;
-  buf = malloc(bufSize);
-  snprintf(buf, bufSize, "Ln %d, Col %d", E.Cy, E.Cx);
-  int offset = 22;
-  if(bufSize > 22){
-    offset = bufSize;
+  if(job->numPieces == job->capacity){
+    job->capacity = GROW_CAPACITY(job->capacity);
+    job->pieces = realloc(job->pieces, sizeof(struct save_piece) * job->capacity);
+    if(job->pieces == NULL){
+      printf("Memory allocation failed\n");
+      exit(1);
+    }
   }
-  E.Cy = E.w.ws_row + E.scroll + 1;
-  E.Cx = E.sidescroll + E.w.ws_col - offset;
-  cursor_move_cmd();
-  write(STDOUT_FILENO, "\x1b[0J", 4);
-  write(STDOUT_FILENO, buf, bufSize);
+  struct save_piece *piece = &job->pieces[job->numPieces++];
+  piece->text = text;
+  piece->length = length;
+  piece->newline = newline;
+}
 
-  E.Cx = oldX;
-  E.Cy = oldY;
-  free(buf);
+void listSaveRows(struct save_job *job, rownode *node){
+  /***
+   * Add the text of a subtree of the snapshot to the save's pieces in row order, every row with a \n after it. Runs
+   * on the save's thread, the main thread doesn't change any of these nodes while the save runs
+   */
+  if(node == NULL) return;
+  listSaveRows(job, node->left);
+  row *r = &node->r;
+  if(r->chars == NULL){ //unloaded span, it goes straight from the mapped file to the temp file
+    addSavePiece(job, job->data + node->spanStart, node->spanLen, 1);
+  } else if(r->gapStart == r->length){
+    addSavePiece(job, r->chars, r->length, 1);
+  } else { //the text on both sides of the gap, so the gap doesn't have to be moved
+    addSavePiece(job, r->chars, r->gapStart, 0);
+    addSavePiece(job, r->chars + r->gapEnd, r->length - r->gapStart, 1);
+  }
+  listSaveRows(job, node->right);
 }
 
-void incrementCursor(int up, int down, int left, int right){  
+void* saveWorker(void *arg){
   /***
-   * Increment the position of the global editor object's cursor
+   * Runs on the background save's thread, writes the snapshot to the temp file, syncs it and renames it over the file
    */
-    if((up^down^left^right) != 1 || up+down+left+right != 1){
-      printf("Only one parameter can be 1, all others must be 0");
-      return;
+  struct save_job *job = arg;
+  listSaveRows(job, job->root); //note that a \r is NOT written
+  if(job->tail < job->size){ //the rest of a mapped file the indexer hadn't handed over, from the start of its line
+    addSavePiece(job, job->data + job->tail, job->size - job->tail, 0);
+  } else {
+    job->pieces[job->numPieces - 1].newline = 0; //the last row doesn't end with a \n
+  }
+  long long total = 0;
+  for(size_t i = 0; i < job->numPieces; i++) total += job->pieces[i].length + job->pieces[i].newline;
+  pthread_mutex_lock(&job->lock);
+  job->total = total;
+  pthread_mutex_unlock(&job->lock);
+
+  struct save_writer w = {.fd = job->fd};
+  long long reported = 0;
+  if(posix_memalign((void **)&w.block, SAVE_ALIGN, SAVE_BLOCK) != 0){
+    printf("Memory allocation failed\n");
+    exit(1);
+  }
+  for(size_t i = 0; i < job->numPieces && w.error == 0; i++){
+    saveBytes(&w, job->pieces[i].text, job->pieces[i].length);
+    if(job->pieces[i].newline) saveBytes(&w, "\n", 1);
+    if(w.written != reported){ //a block went out, let the editor know how far along it is
+      reported = w.written;
+      pthread_mutex_lock(&job->lock);
+      job->written = reported;
+      pthread_mutex_unlock(&job->lock);
     }
-    if(up && !down && !left && !right){ //up arrow
-      if(E.Cy > 1){
-        E.Cy--; //only deccrement if C.y is > 1, note that going up decrements C.y as the top left of the screen is 1,1
-        //keep moving the cursor left until it hits a printable character or 
-        //beginning of the row
-        if(E.Cx > E.rows[E.Cy-1].length + 1){
-          while(E.Cx > E.rows[E.Cy-1].length + 1){
-            E.Cx--; //snap cursor to end of row
-          }
-        }
-      }
-    } else if(!up && down && !left && !right){ //down arrow
-      if(E.Cy <= E.scroll + E.w.ws_row){ 
-        E.Cy++; //only increment C.y if y is < rows limit, the row limit is positive and represents the lowest row of the screen
-        //keep moving the cursor left until it hits a printable character or 
-        //beginning of the row
-        while(E.Cx > E.rows[E.Cy-1].length + 1){
-          E.Cx--; //snap cursor to end of row
-        }
-      }
-    } else if(!up && !down && left && !right){ //left arrow
-      if(E.Cx > 1){
-        E.Cx--; //only increment if C.x is > 1, we have to use 1 because the cursor actually controls the character behind it
-      }
-    } else if(!up && !down && !left && right){ //right arrow
-      if(E.Cx <= E.sidescroll + E.w.ws_col){
-        E.Cx++; //only increment if C.x < columns limit, the column limit is positive and represents the farthest right column on screen
-      }
+  }
+  flushSave(&w, NULL, 0);
+  free(w.block);
+
+  if(w.error == 0 && fsync(job->fd) == -1) w.error = errno; //the text has to be on disk before the rename makes it the file
+  if(close(job->fd) == -1 && w.error == 0) w.error = errno;
+  if(w.error == 0 && rename(job->tmpname, job->path) == -1) w.error = errno;
+  if(w.error != 0){
+    unlink(job->tmpname); //the old file is untouched
+  } else {
+    char *slash = strrchr(job->path, '/'); //sync the directory too so the rename itself survives a crash
+    if(slash != NULL) *slash = '\0';
+    int dir = open(slash != NULL ? (slash == job->path ? "/" : job->path) : ".", O_RDONLY | O_DIRECTORY);
+    if(dir != -1){
+      fsync(dir);
+      close(dir);
     }
-}   
+  }
+  pthread_mutex_lock(&job->lock);
+  job->written = w.written;
+  job->error = w.error;
+  job->finished = 1;
+  job->end = nowSeconds(); //the buffer may be stashed, it's only joined once it's switched back to
+  pthread_mutex_unlock(&job->lock);
+  return NULL;
+}
 
-void moveCursor(char *buf){
+void applySaveResult(void){
   /***
-   * Map user arrow key presses to cursor movements
+   * Show how far along the background save is, and once it's done how it went
    */
-    switch (buf[2])
-    {
-    case 'A': //up arrow
-      incrementCursor(1,0,0,0); //increment the cursor's coordinates(stored in the global editor E)
-      break;
-    case 'B': //down arrow
-      if(E.Cy <= E.numrows - 1) incrementCursor(0,1,0,0); //limit cursor to one above the lowest row
-      break;
-    case 'C': //right arrow
-      if(E.Cx <= E.rows[E.Cy-1].length) incrementCursor(0,0,0,1); //limit cursor at only one space further right than the text
-      break;
-    case 'D': //left arrow
-      incrementCursor(0,0,1,0);
-      break;
-    default:
-      break;
-    } 
+  if(!saveJob->running) return;
+  pthread_mutex_lock(&saveJob->lock);
+  int finished = saveJob->finished;
+  long long written = saveJob->written;
+  long long total = saveJob->total;
+  pthread_mutex_unlock(&saveJob->lock);
+  if(finished){
+    endSave();
+  } else {
+    snprintf(statusMessage, sizeof(statusMessage), "Saving %s, %d%%", saveJob->filename,
+             total > 0 ? (int)(written * 100 / total) : 0);
+  }
 }
 
-/*** Scrolling Methods ***/
-void scrollUp(void){
-  if(E.scroll > 0) E.scroll--;
+void endSave(void){
+  /***
+   * Join the background save, waiting for it if it isn't done, and put how it went in the status bar. If the save
+   * went to the buffer's file the text is marked as saved as of the edit the snapshot was taken at, so edits made while
+   * the save ran still count as unsaved. Saving a copy somewhere else leaves the buffer as unsaved as it was
+   */
+  pthread_join(saveJob->thread, NULL);
+  saveJob->running = 0; //the save doesn't read the snapshot's rows anymore
+  for(int i = 0; i < saveJob->numRetired; i++){ //the nodes that were copied, their text belongs to the copies
+    rownode *node = saveJob->retired[i];
+    node->r.chars = NULL;
+    node->lines = 0;
+    node->right = pool.freeList;
+    pool.freeList = node;
+  }
+  saveJob->numRetired = 0;
+  releaseOrphans();
+  free(saveJob->path);
+  free(saveJob->tmpname);
+  if(saveJob->error != 0){
+    snprintf(statusMessage, sizeof(statusMessage), "Error saving %s: %s", saveJob->filename, strerror(saveJob->error));
+    free(saveJob->adopt);
+    saveJob->adopt = NULL;
+    return;
+  }
+  if(saveJob->adopt != NULL){ //the buffer had no file, it's now the one it was saved to
+    CURRENT_FILENAME = saveJob->adopt;
+    saveJob->adopt = NULL;
+    saveJob->ownFile = 1;
+  }
+  if(saveJob->ownFile) E.savedChanges = saveJob->changes;
+  double seconds = saveJob->end - saveJob->start;
+  snprintf(statusMessage, sizeof(statusMessage), "%lld bytes written to %s (%.1f MB/s)", saveJob->written,
+           saveJob->filename, seconds > 0 ? saveJob->written / seconds / (1024 * 1024) : 0.0);
 }
 
-void scrollDown(void){
-  E.scroll++;
+void waitForSave(void){
+  /***
+   * Wait for the background save to finish if one is running, used before exiting and before starting another save
+   */
+  if(saveJob != NULL && saveJob->running) endSave();
 }
 
-void scrollRight(void){
-  E.sidescroll++;
+void saveBytes(struct save_writer *w, const char *data, size_t len){
+  /***
+   * Add text to the file being saved. Small pieces are gathered into the block, pieces too big to be worth
+   * copying are written along with the block in one writev
+   */
+  if(len >= SAVE_BLOCK - w->used && len >= SAVE_DIRECT){
+    flushSave(w, data, len);
+    return;
+  }
+  while(len > 0){
+    size_t room = SAVE_BLOCK - w->used;
+    size_t n = len < room ? len : room;
+    memcpy(w->block + w->used, data, n);
+    w->used += n;
+    data += n;
+    len -= n;
+    if(w->used == SAVE_BLOCK) flushSave(w, NULL, 0);
+  }
 }
 
-void scrollLeft(void){
-  if(E.sidescroll > 0) E.sidescroll--;
+void flushSave(struct save_writer *w, const char *data, size_t len){
+  /***
+   * Write out the block and then len bytes of data if there are any, retrying short writes. After a failed
+   * write the error is kept and nothing else is written
+   */
+  struct iovec iov[2] = {{w->block, w->used}, {(void *)data, len}};
+  int first = 0;
+  if(w->error != 0){
+    w->used = 0;
+    return;
+  }
+  w->written += w->used + len;
+  w->used = 0;
+  while(first < 2){
+    if(iov[first].iov_len == 0){
+      first++;
+      continue;
+    }
+    ssize_t n = writev(w->fd, iov + first, 2 - first);
+    if(n == -1){
+      if(errno == EINTR) continue;
+      w->error = errno;
+      return;
+    }
+    while(first < 2 && (size_t)n >= iov[first].iov_len){ //skip past what was written
+      n -= iov[first].iov_len;
+      iov[first].iov_len = 0;
+      first++;
+    }
+    if(first < 2){
+      iov[first].iov_base = (char *)iov[first].iov_base + n;
+      iov[first].iov_len -= n;
+    }
+  }
 }
 
-void scrollCheck(void){
+/*** Searching Methods ***/
+const char* compileSearch(int regex){
   /***
-   * Check if the editor needs to scroll up or down in response to user inputs
+   * Compile searchQuery, as a regex if regex is 1. Returns what's wrong with the pattern if it isn't a valid regex.
+   * A plain search gets a Boyer-Moore-Horspool skip table: when the text under the last byte of the query is c,
+   * the query can slide forward until its last other c lines up with it, or all the way past it
    */
-  if((E.Cy) - E.scroll > E.w.ws_row){
-    scrollDown();
-  } else if ((E.Cy-1) < E.scroll){
-    scrollUp();
+  regexFree(search.regex);
+  search.regex = NULL;
+  search.length = strlen(searchQuery);
+  if(regex){
+    const char *error = NULL;
+    search.regex = regexCompile(searchQuery, &error);
+    return error;
   }
+  for(int i = 0; i < 256; i++) search.skip[i] = search.length;
+  for(int i = 0; i < search.length - 1; i++) search.skip[(unsigned char)searchQuery[i]] = search.length - 1 - i;
+  return NULL;
 }
 
-void sidescrollCheck(void){
+const char* setSearchQuery(const char *query, int regex){
   /***
-   * Check if the editor needs to scroll left or right in response to user inputs
+   * Make query the search query and compile it, see compileSearch()
    */
-  if(E.Cx - E.sidescroll > E.w.ws_col){
-    scrollRight();
-  } else if (E.Cx-1 < E.sidescroll){
-    E.sidescroll = E.Cx-1;
-  }
+  snprintf(searchQuery, sizeof(searchQuery), "%s", query);
+  return compileSearch(regex);
 }
 
-/*** Charcater Manipulation Methods ***/
-void insertStr(char **original, char* insert, size_t index){
+int countQueryMatches(const char *text, size_t len){
   /***
-   * Insert the string insert into original at index
+   * Count the matches of the search query in the len bytes at text
    */
-  if(index > strlen(*original)){
-    printf("%s", "index out of bounds");
-    exit(1);
-  }
+  return countMatches(search.regex, text, len);
+}
 
-  char *result = malloc(strlen(*original) + strlen(insert) + 1);
-  if(result == NULL){
-    printf("Memory allocation failed");
-    exit(1);
+const char* findMatch(const char *text, size_t len){
+  /***
+   * Returns the first match of the plain query in the len bytes at text, or NULL if there isn't one. A one
+   * byte query is left to memchr, which looks at many bytes at a time
+   */
+  size_t length = search.length;
+  if(length == 0 || length > len) return NULL;
+  if(length == 1) return memchr(text, searchQuery[0], len);
+  unsigned char last = searchQuery[length - 1];
+  for(size_t pos = 0; pos + length <= len; ){
+    unsigned char c = text[pos + length - 1];
+    if(c == last && memcmp(text + pos, searchQuery, length - 1) == 0) return text + pos;
+    pos += search.skip[c];
   }
+  return NULL;
+}
 
-  strncpy(result, *original, index);
-  
-  strcpy(result + index, insert);
-
-  strcpy(result + index + strlen(insert), *original + index);
-
-  free(*original);
-  *original = result;
+void startMatches(struct match_scan *scan, struct regex *regex, const char *text, size_t len){
+  /***
+   * Start going through the matches in the len bytes at text, of regex or of the plain query if regex is NULL.
+   * Matches never cross a \n, so the text can be a whole span of lines
+   */
+  scan->text = text;
+  scan->len = len;
+  scan->pos = 0;
+  scan->regex = regex;
+  if(regex != NULL) regexMarkStarts(regex, text, len);
 }
 
-void shiftLineCharsR(int index, row *row){ 
+int nextMatch(struct match_scan *scan){
   /***
-   * Shift all characters in a row up to index right by 1
-   */                                  
-  for (int i = row->length - 1; i > index; i--) {
-    row->chars[i] = row->chars[i - 1];
+   * Find the next match of the scan and set its start and end, returns 0 when there are no more. Matches don't
+   * overlap, so "aa" is found once in "aaa"
+   */
+  if(scan->regex != NULL){
+    if(!regexNext(scan->regex, scan->text, scan->len, scan->pos, &scan->start, &scan->end)) return 0;
+  } else {
+    const char *found = findMatch(scan->text + scan->pos, scan->len - scan->pos);
+    if(found == NULL) return 0;
+    scan->start = found - scan->text;
+    scan->end = scan->start + search.length;
   }
+  scan->pos = scan->end;
+  return 1;
 }
 
-void shiftLineCharsL(int index, row *row){
+int countMatches(struct regex *regex, const char *text, size_t len){
   /***
-   * Shift all characters in a row to the right of index one to the left
+   * Count the matches in the len bytes at text
    */
-  for (int i = index; i < row->length - 1; i++) {
-    row->chars[i] = row->chars[i + 1];
-  }
+  struct match_scan scan;
+  int count = 0;
+  startMatches(&scan, regex, text, len);
+  while(nextMatch(&scan)) count++;
+  return count;
 }
 
-void addPrintableChar(char c) {
+int nthMatch(const char *text, size_t len, int n, int *end){
   /***
-   * Write a printable characters to the screen in response to user input
+   * Returns where the n'th(0 indexed) match in the len bytes at text starts and sets end to where it ends,
+   * or returns -1 if there aren't that many
    */
-  if (E.Cx - E.sidescroll <= E.w.ws_col) {
-    //temporary pointer to the row we're editing
-    row *currentRow = &E.rows[E.Cy-1];
-    
-    //double capacity if needed
-    if (currentRow->length + 2 > (int)currentRow->capacity) {//+2 for new char and null terminator
-      size_t new_capacity = GROW_CAPACITY(currentRow->capacity);
-      //make sure we don't drop below MIN_ROW_CAPACITY
-      if (new_capacity < MIN_ROW_CAPACITY) new_capacity = MIN_ROW_CAPACITY;
-      
-      //allocate memory to a new row
-      char *new_chars = realloc(currentRow->chars, new_capacity);
-      if (new_chars == NULL) {
-          // Handle memory allocation failure
-          return;
-      }
-      
-      //initialize newly allocated memory
-      memset(new_chars + currentRow->capacity, 0, new_capacity - currentRow->capacity);
-      
-      //update global editor object's row to new_chars and new_capacity
-      currentRow->chars = new_chars;
-      currentRow->capacity = new_capacity;
-    }
-    
-    //shift characters right to make room for the new one
-    memmove(&currentRow->chars[E.Cx], &currentRow->chars[E.Cx-1], currentRow->length - E.Cx + 1);
-    
-    //insert the new character
-    currentRow->chars[E.Cx-1] = c;
-    //increment row length
-    currentRow->length++;
-
-    currentRow->chars[currentRow->length] = '\0'; //ensure row is always null terminated    
-    E.Cx++; //increment cursor to account for the new character 
-    if(E.Cx - E.sidescroll > E.w.ws_col){ //check if we need to scroll
-      scrollRight();
+  struct match_scan scan;
+  startMatches(&scan, search.regex, text, len);
+  while(nextMatch(&scan)){
+    if(n-- == 0){
+      *end = scan.end;
+      return scan.start;
     }
   }
+  return -1;
 }
 
-void tabPressed(){
+char* searchRowText(row *r){
   /***
-   * Write 4 spaces to the screen in response to the user pressing tab
+   * Returns a row's text as one piece, the row itself when its gap is at the end and otherwise a copy
    */
-  for(int i = 0; i < 4; i++){
-    addPrintableChar(' ');
-  }
+  return r->gapStart == r->length ? r->chars : highlightText(r);
 }
 
-void backspacePrintableChar(void) {
+int matchesBeforeColumn(row *r, int col){
   /***
-   * Delete a printable character in response to the user pressing backspace
+   * Count the matches in a row that start before col
    */
-  if (E.Cx > 1) {
-    //temporary pointer to current row we're editing
-    row *currentRow = &E.rows[E.Cy-1];
-
-    //shift left all the characters up to the cursor in the row
-    memmove(&currentRow->chars[E.Cx-1], &currentRow->chars[E.Cx], currentRow->length - E.Cx + 1);
-    currentRow->length--;
-    
-    //+1 to account for null terminator
-    size_t new_capacity = currentRow->length + 1;
-    //make sure we don't drop below MIN_ROW_CAPACITY
-    if (new_capacity < MIN_ROW_CAPACITY) new_capacity = MIN_ROW_CAPACITY;
-          
-    //delete the last character
-    currentRow->chars[currentRow->length] = '\0';
-    //decrement character to account for the new shorter row
-    E.Cx--;
-    if(E.Cx <= E.sidescroll){
-      scrollLeft();
-    } 
-  }
+  struct match_scan scan;
+  int count = 0;
+  startMatches(&scan, search.regex, searchRowText(r), r->length);
+  while(nextMatch(&scan) && scan.start < (size_t)col) count++;
+  return count;
 }
 
-void deletePrintableChar(void){
+void searchRow(rownode *node){
   /***
-   * Delete a printable character in response to the user pressing delete
+   * Count the matches in a node's own text, an unloaded span is searched right in the mapped file
    */
-  if(E.Cx > 0){
-    //temporary pointer to current row we're editing
-    row *currentRow = &E.rows[E.Cy-1];
-
-    //shift left all the characters up to the cursor in the row
-    memmove(&currentRow->chars[E.Cx-1], &currentRow->chars[E.Cx], currentRow->length - E.Cx + 1);
-    currentRow->length--;
-    
-    //+1 to account for null terminator
-    size_t new_capacity = currentRow->length + 1;
-    //make sure we don't drop below MIN_ROW_CAPACITY
-    if (new_capacity < MIN_ROW_CAPACITY) new_capacity = MIN_ROW_CAPACITY;
-    
-    currentRow->chars[currentRow->length] = '\0';
-    //DO NOT decrement character to account for the new shorter row
-    //this is how delete is different from backspace
+  if(node->r.chars == NULL){
+    node->matches = countMatches(search.regex, mapped.data + node->spanStart, node->spanLen);
+  } else {
+    node->matches = countMatches(search.regex, searchRowText(&node->r), node->r.length);
   }
 }
 
-/*** User Input Processing ***/
-void searchPrompt(void){
+void countNode(rownode *node){
   /***
-   * Prompt the user for what words they want to search for
+   * Count a node's matches right away if a search is on, used for nodes small enough not to need the background
+   * search. The caller fixes the counts of the nodes above it
    */
-  int oldX = E.Cx;
-  int oldY = E.Cy;
-  statusWrite("Search: ");
+  if(!searchFlag) return;
+  searchRow(node);
+  node->searched = search.generation;
+}
 
-  exitRawMode();
-  fgets(searchQuery, sizeof(searchQuery), stdin);
-  searchQuery[strcspn(searchQuery, "\n")] = '\0';
-  enableRawMode();
-  E.Cx = oldX;
-  E.Cy = oldY;
+/*** Background Search ***/
+int nodeCounted(rownode *node){
+  /***
+   * Check if a node's count is good for the current search, either counted for it or counted with no matches for
+   * a query the current one starts with
+   */
+  return node->searched == search.generation || (node->searched >= search.narrowBase && node->matches == 0);
 }
 
-void sortEscapes(char c){
+int subtreeCounted(rownode *node){
   /***
-   * Determine whether or not the user pressed delete or an arrow key and call the appropriate methods
+   * Check if every node of a subtree is counted for the current search
    */
-  char *buff = malloc(4); //three character buffer to store all three characters of the arrow key commands
-  buff[0] = c;
-  read(STDIN_FILENO, buff + 1, 1); //read next byte of input into buf
-  read(STDIN_FILENO, buff + 2, 1); //read next byte of input into buf
-  if(buff[2] == '3'){ //delete key was pressed
-    read(STDIN_FILENO, buff + 3, 1); //read in the last tilde of the delete sequence ("\x1b[3~")
-    if(E.rows[E.Cy-1].length != 0){ //check if the row isn't empty
-      int current_char = (int)E.rows[E.Cy-1].chars[E.Cx - 1];
-      if(current_char >= 32 && current_char < 127){ //check if the current character the cursor is on is a printable character
-        deletePrintableChar();
+  return node->subtreeSearched >= search.narrowBase && node->subtreeHit >= search.generation;
+}
+
+int collectPieces(rownode *node, int first){
+  /***
+   * Add the nodes of a subtree that aren't counted for the current search to the background search's snapshot in
+   * row order, leaving out the rows before searchJob.resume. first is the index of the subtree's first row. Returns
+   * 1 if the snapshot filled up, resume is then set to the row the next chunk starts at
+   */
+  if(node == NULL || subtreeCounted(node) || first + node->size <= searchJob.resume) return 0;
+  if(collectPieces(node->left, first)) return 1;
+  int row = first + nodeSize(node->left);
+  if(row >= searchJob.resume && !nodeCounted(node)){
+    if(searchJob.numPieces == SEARCH_CHUNK){
+      searchJob.resume = row;
+      return 1;
+    }
+    if(searchJob.numPieces == searchJob.capacity){
+      searchJob.capacity = GROW_CAPACITY(searchJob.capacity);
+      searchJob.pieces = realloc(searchJob.pieces, sizeof(struct search_piece) * searchJob.capacity);
+      if(searchJob.pieces == NULL){
+        printf("Memory allocation failed\n");
+        exit(1);
       }
-    } else if(E.Cy != E.numrows){ //check that the cursor isn't on the bottom row
-      removeRow(0);
     }
-  } else { //arrow key was pressed 
-    moveCursor(buff); //moveCursor will only increment C's position, we can't just increment Cy or Cx because we have to 
-    //read in the rest of the command buffer, so that's why we use a separate moveCursor function
+    struct search_piece *piece = &searchJob.pieces[searchJob.numPieces++];
+    piece->node = node;
+    piece->lines = node->lines;
+    piece->row = row;
+    piece->version = node->r.version;
+    if(node->r.chars == NULL){
+      piece->chars = mapped.data + node->spanStart;
+      piece->length = node->spanLen;
+      piece->gapStart = node->spanLen;
+      piece->gapEnd = node->spanLen;
+    } else {
+      node->r.snapshot = searchJob.id; //the row copies its text before changing it from now on
+      piece->chars = node->r.chars;
+      piece->length = node->r.length;
+      piece->gapStart = node->r.gapStart;
+      piece->gapEnd = node->r.gapEnd;
+    }
+    searchJob.totalBytes += piece->length;
   }
-  free(buff); //free memory allocated to buff
-  buff = NULL; //set buf back to NULL
+  return collectPieces(node->right, row + node->lines);
 }
 
-void sortKeypress(char c){
+void* searchWorker(void *arg){
   /***
-   * This function will determine based on the key pressed if the desired action should be
-   * 1. Insert a printable character
-   * 2. Move the cursor(this doesn't actually write/delete any characters or create/delete rows
-   *    it only sends a command to the terminal)
-   * 3. Delete a character(backspace)         
-   * 4. Shift all characters in a row(space)
-   * 5. Create a new line(enter)
-   * 6. Delete a row(backspace or enter)
-   * 7. Save File(ctrl+s)
-   * 8. Search for word(ctrl+b)
-   * Each of these (1-8) will have their own function(s), which sortKeypress will call
+   * Runs on the background search's thread, counts the matches of every piece and hands the counts back
+   * every SEARCH_BATCH bytes, stopping there if the search was cancelled
    */
-  int ascii_code = (int)c;
-  if(ascii_code >= 32 && ascii_code < 127){ //the character inputted is a printable character
-    addPrintableChar(c);
-  } else if (ascii_code == 13){ //user pressed enter
-    addRow();
-  } else if (ascii_code == 127){ //user pressed backspace
-    if((E.Cx-1 == 0) && (E.Cy > 1)){ //check if cursor is at far left of screen and not on the highest row
-      removeRow(1);
-    }else{
-      backspacePrintableChar();
+  struct search_job *job = arg;
+  size_t batch = 0;
+  for(size_t i = 0; i < job->numPieces; i++){
+    struct search_piece *piece = &job->pieces[i];
+    const char *text = piece->chars;
+    if(piece->gapStart < (int)piece->length){ //join the halves of a row whose gap isn't at the end
+      if(piece->length > job->textCapacity){
+        job->textCapacity = piece->length > 2 * job->textCapacity ? piece->length : 2 * job->textCapacity;
+        job->text = realloc(job->text, job->textCapacity);
+        if(job->text == NULL){
+          printf("Memory allocation failed\n");
+          exit(1);
+        }
+      }
+      memcpy(job->text, piece->chars, piece->gapStart);
+      memcpy(job->text + piece->gapStart, piece->chars + piece->gapEnd, piece->length - piece->gapStart);
+      text = job->text;
+    }
+    piece->count = countMatches(job->regex, text, piece->length);
+    batch += piece->length + 1;
+    if(batch >= (size_t)SEARCH_BATCH || i == job->numPieces - 1){
+      batch = 0;
+      pthread_mutex_lock(&job->lock);
+      job->done = i + 1;
+      int cancel = job->cancel;
+      pthread_mutex_unlock(&job->lock);
+      if(cancel) break;
     }
-  } else if (ascii_code == 27){ //escape character was pressed, weird functions coming up
-    sortEscapes(c);
-  } else if (ascii_code == 9){ //tab was pressed
-    tabPressed();
-  } else if (c == CTRL_KEY('s')){ //ctrl+s was pressed
-    saveFile();
-  }else if (c == CTRL_KEY('b')){ //ctrl+b was pressed
-    if(searchFlag == 0) searchPrompt();
-    //searchQuery[0] = 'v'; //for debug purposes only
-    //searchQuery[1] = 'o';
-    //searchQuery[2] = 'i';
-    //searchQuery[3] = 'd';
-    //searchQuery[4] = '\0';
-    searchFlag = !searchFlag;
-  } else { //one of the unmapped keys was pressed so just do nothing
-    return;
   }
+  return NULL;
 }
 
-/*** Visible Output ***/
-void cursor_move_cmd(void){ 
+int pieceIsCurrent(struct search_piece *piece){
+  /***
+   * Check if a piece's node still holds the text the worker counted, a row that was changed has copied its
+   * text or has a new version, and a span that had a line loaded out of it has different lines
+   */
+  rownode *node = piece->node;
+  if(node->searched == search.generation) return 0; //counted again since, the worker's count is older
+  if(node->r.chars == NULL){
+    return node->lines == piece->lines && mapped.data + node->spanStart == piece->chars && node->spanLen == piece->length;
+  }
+  return node->r.chars == piece->chars && node->r.version == piece->version;
+}
+
+void sumMarked(rownode *node){
+  /***
+   * Redo the sums of the marked nodes of a subtree, children first. A marked node has summed set to 0, which no
+   * search has, and every node above a marked node is marked as well
+   */
+  if(node == NULL || node->summed != 0) return;
+  sumMarked(node->left);
+  sumMarked(node->right);
+  updateNode(node);
+}
+
+void applyPieces(size_t done){
   /***
-   * Write the commands to STDOUT to make the visual change of moving the cursor to the location specified by
-   * the global editor object E
+   * Put the counts of the first done pieces into the row tree, skipping the ones applied before. The nodes above
+   * them are marked and then summed in one go, so a node above thousands of counted rows is only summed once
    */
-  write(STDOUT_FILENO, "\x1b[?25l", 6); //make cursor invisible
-  int buf_size = snprintf(NULL, 0, "\x1b[%d;%dH", E.Cy, E.Cx)+1;
-  char *buf = malloc(buf_size);
-  if(buf == NULL){
-    printf("%s", "Memory allocation failed\n");
+  for(; searchJob.applied < done; searchJob.applied++){
+    struct search_piece *piece = &searchJob.pieces[searchJob.applied];
+    if(piece->row + piece->lines > searchJob.progress) searchJob.progress = piece->row + piece->lines;
+    if(!pieceIsCurrent(piece)) continue;
+    piece->node->matches = piece->count;
+    piece->node->searched = search.generation;
+    for(rownode *p = piece->node; p != NULL && p->summed != 0; p = p->parent) p->summed = 0;
   }
-  snprintf(buf, buf_size, "\x1b[%d;%dH", E.Cy-E.scroll, E.Cx - E.sidescroll);
-  write(STDOUT_FILENO, buf, buf_size-1); //move cursor to location specified by Cx and Cy
-  write(STDOUT_FILENO, "\x1b[?25h", 6); //make cursor visible
+  sumMarked(E.rows);
+}
 
-  if (buf != NULL) { //null check before freeing
-    free(buf);
+void applySearchResults(void){
+  /***
+   * Put the counts the worker has handed back so far into the row tree. Once it's done, the next chunk of the
+   * snapshot is started if there is one
+   */
+  if(!searchJob.running) return;
+  pthread_mutex_lock(&searchJob.lock);
+  size_t done = searchJob.done;
+  pthread_mutex_unlock(&searchJob.lock);
+  applyPieces(done);
+  if(done < searchJob.numPieces) return;
+  stopSearchJob();
+  if(searchJob.more){
+    searchInBackground();
+  } else if(prompt.jumpPending){ //the match to move to can be found now
+    promptJump();
   }
+}
 
-  buf = NULL; //set buf back to NULL
+void stopSearchJob(void){
+  /***
+   * Stop the background search if it is running, the counts it finished are kept and the nodes it didn't get
+   * to are left uncounted
+   */
+  if(!searchJob.running) return;
+  pthread_mutex_lock(&searchJob.lock);
+  searchJob.cancel = 1;
+  pthread_mutex_unlock(&searchJob.lock);
+  pthread_join(searchJob.thread, NULL);
+  applyPieces(searchJob.done);
+  searchJob.running = 0; //the search doesn't read the snapshot's rows anymore
+  releaseOrphans();
+  regexFree(searchJob.regex);
+  searchJob.regex = NULL;
 }
 
-char processKeypress(void){
+void startSearch(int narrowing){
   /***
-   * Return the key pressed by the user and check if the user pressed ctrl+c to exit the editor
+   * Start counting the matches of a new query. If narrowing is 1 the query starts with the one before it, so the
+   * nodes that had no matches of that one are already counted
    */
-  char c = '\0';
-  read(STDIN_FILENO, &c, 1);
-  if(c == CTRL_KEY('c')){ //used to check if key pressed was ctrl+c which is the key to close the editor
-    write(STDOUT_FILENO, "\x1b[2J", 4); //clear entire screen
-    write(STDOUT_FILENO, "\x1b[f", 3);  //move cursor to top left of screen
-    free_all_rows();
-    exit(0);
-  }
-  return c;
+  stopSearchJob();
+  search.generation++; //every count so far is for an older query now
+  if(!narrowing) search.narrowBase = search.generation;
+  searchJob.resume = 0;
+  searchJob.progress = 0;
+  searchInBackground();
 }
 
-void clearScreen(void){
+void searchInBackground(void){
   /***
-   * Write the commands to clear the screen except for the status message row
+   * Count the matches of every node that isn't counted for the current search yet. A little text is counted right
+   * away, more than SEARCH_INLINE bytes is left to the worker thread while the editor keeps going. A search that
+   * is already running is stopped first and goes on from the chunk it was on, with the nodes it finished left out.
+   * A search that didn't start at the first row takes one more look from there when it gets to the end, in case
+   * edits moved rows it hadn't counted above where it started
    */
-  int buf_size = snprintf(NULL, 0, "\x1b[%d;%dH", E.w.ws_row, E.w.ws_col)+1;
-  char *move_cmd = malloc(buf_size);
-  snprintf(move_cmd, buf_size, "\x1b[%d;%dH", E.w.ws_row, E.w.ws_col);
-  write(STDOUT_FILENO, move_cmd, buf_size-1);
+  stopSearchJob();
+  search.uncounted = 0;
+  searchJob.id = ++snapshots.lastId;
+  searchJob.numPieces = 0;
+  searchJob.totalBytes = 0;
+  searchJob.done = 0;
+  searchJob.applied = 0;
+  searchJob.cancel = 0;
+  int from;
+  do {
+    from = searchJob.resume;
+    if(!collectPieces(E.rows, 0)) searchJob.resume = 0;
+  } while(searchJob.numPieces == 0 && from > 0);
+  searchJob.more = from > 0 || searchJob.resume > 0;
+  if(searchJob.numPieces == 0) return;
 
-  write(STDOUT_FILENO, "\x1b[1J", 4); //clear the entire screen(except status message row)
-  write(STDOUT_FILENO, "\x1b[H", 3); //reset cursor to top left(visible change)
-  free(move_cmd);
+  const char *error = NULL;
+  searchJob.regex = search.regex != NULL ? regexCompile(searchQuery, &error) : NULL;
+  if(searchJob.totalBytes < (size_t)SEARCH_INLINE && !searchJob.more){
+    searchWorker(&searchJob);
+    applyPieces(searchJob.done);
+    regexFree(searchJob.regex);
+    searchJob.regex = NULL;
+    return;
+  }
+  searchJob.running = 1;
+  pthread_create(&searchJob.thread, NULL, searchWorker, &searchJob);
 }
 
-void writeScreen(void){
+int matchesBeforeRow(int index){
   /***
-   * This will write each row within the global editor object's dynamic arrow of rows to the screen, account for comments,
-   * syntax highlighting, and search highlighting
+   * Count the matches in the rows before index, the row at index has to be loaded
    */
-  int *markedRows;
-  markedRows = markMultilineRows(); //mark all the rows highlighted by a multiline comment
-  if(E.numrows - E.scroll < E.w.ws_row){
-    for(int i = E.scroll; i < E.numrows - 1; i++){
-      char* written_chars;
-      int commented; //the index at which a // occurs if it does
-      row dup_row = duplicate_row(&E.rows[i]);
-      if(searchFlag) {
-        written_chars = sideScrollCharSet(&dup_row);
-        commented = inlineCommentHighlight(&written_chars);
-        searchHighlight(&written_chars, commented, markedRows[i]);
-        if(markedRows[i] == 0) highlightSyntax(&written_chars, commented);
-      } else {
-        written_chars = sideScrollCharSet(&dup_row);
-        commented = inlineCommentHighlight(&written_chars);
-        if(markedRows[i] == 0) highlightSyntax(&written_chars, commented);
-      }
-      if(markedRows[i]) multilineCommentHighlight(&written_chars);
-      add_cmd(written_chars, 0);
-      add_cmd("\r\n", 0);
-      free(dup_row.chars);
-      if(written_chars != NULL) free(written_chars);
-    }
-    if(E.rows[E.numrows-1].chars != NULL){ 
-      char* written_chars;
-      int commented;
-      row dup_row = duplicate_row(&E.rows[E.numrows-1]);
-      if(searchFlag) {
-        written_chars = sideScrollCharSet(&dup_row);
-        commented = inlineCommentHighlight(&written_chars);
-        searchHighlight(&written_chars, commented, markedRows[E.numrows-1]);
-        if(markedRows[E.numrows-1] == 0) highlightSyntax(&written_chars, commented);
-      } else {
-        written_chars = sideScrollCharSet(&dup_row);
-        commented = inlineCommentHighlight(&written_chars);
-        if(markedRows[E.numrows-1] == 0) highlightSyntax(&written_chars, commented);
-      }
-      if(markedRows[E.numrows-1]) multilineCommentHighlight(&written_chars);
-      add_cmd(written_chars, 0);
-      free(dup_row.chars);
-      if(written_chars != NULL) free(written_chars);
+  int count = 0;
+  rownode *node = E.rows;
+  while(node != NULL){
+    int leftSize = nodeSize(node->left);
+    if(index < leftSize){
+      node = node->left;
+    } else {
+      count += nodeMatches(node->left);
+      if(index < leftSize + node->lines) return count;
+      count += ownMatches(node);
+      index -= leftSize + node->lines;
+      node = node->right;
     }
-  } else {
-    for(int i = E.scroll; i < E.scroll + E.w.ws_row - 1; i++){
-      char* written_chars;
-      int commented;
-      row dup_row = duplicate_row(&E.rows[i]);
-      if(searchFlag) {
-        written_chars = sideScrollCharSet(&dup_row);
-        commented = inlineCommentHighlight(&written_chars);
-        searchHighlight(&written_chars, commented, markedRows[i]);
-        if(markedRows[i] == 0) highlightSyntax(&written_chars, commented);
-      } else {
-        written_chars = sideScrollCharSet(&dup_row);
-        commented = inlineCommentHighlight(&written_chars);
-        if(markedRows[i] == 0) highlightSyntax(&written_chars, commented);
-      }
-      if(markedRows[i]) multilineCommentHighlight(&written_chars);
-      add_cmd(written_chars, 0);
-      add_cmd("\r\n", 0);
-      free(dup_row.chars);
-      if(written_chars != NULL){
-        free(written_chars);
-      }
+  }
+  return count;
+}
+
+rownode* findMatchNode(int k, int *index, int *rank){
+  /***
+   * Find the node holding the k'th(0 indexed) match of the document, index is set to the node's first row
+   * and rank to which of the node's own matches it is
+   */
+  rownode *node = E.rows;
+  int rowsBefore = 0;
+  while(node != NULL){
+    if(k < nodeMatches(node->left)){
+      node = node->left;
+      continue;
     }
-    if(E.rows[E.scroll + E.w.ws_row - 1].chars != NULL) {
-      char* written_chars;
-      int commented;
-      row dup_row = duplicate_row(&E.rows[E.scroll + E.w.ws_row - 1]);
-      if(searchFlag) {
-        written_chars = sideScrollCharSet(&dup_row);
-        commented = inlineCommentHighlight(&written_chars);
-        searchHighlight(&written_chars, commented, markedRows[E.scroll + E.w.ws_row - 1]);
-        if(commented == 0 && markedRows[E.scroll + E.w.ws_row - 1] == 0) highlightSyntax(&written_chars, commented);
-      } else {
-        written_chars = sideScrollCharSet(&dup_row);
-        commented = inlineCommentHighlight(&written_chars);
-        if(markedRows[E.scroll + E.w.ws_row - 1] == 0) highlightSyntax(&written_chars, commented);
-      }
-      if(markedRows[E.scroll + E.w.ws_row - 1]) multilineCommentHighlight(&written_chars);
-      add_cmd(written_chars, 0);
-      free(dup_row.chars);
-      if(written_chars != NULL) free(written_chars);
+    k -= nodeMatches(node->left);
+    rowsBefore += nodeSize(node->left);
+    if(k < ownMatches(node)){
+      *index = rowsBefore;
+      *rank = k;
+      return node;
     }
+    k -= ownMatches(node);
+    rowsBefore += node->lines;
+    node = node->right;
   }
-  writeCmds();
-  printCursorPos();
-  scrollCheck();
-  sidescrollCheck();
-  cursor_move_cmd(); //move cursor to current cursor position(visible change)
-  free(markedRows);
+  return NULL;
 }
 
-/*** File IO ***/
-void readFile(char *filename) {
+int linesBefore(const char *text, int at){
   /***
-   * Read a file into the global editor object E
+   * Count the \n in the first at bytes of text, which is the line of a span that byte at is on
    */
-  if(strlen(filename) > 256){
-    printf("%s\n", "File name too large");
-    return;
-  }
-  CURRENT_FILENAME = filename; //CURRENT_FILENAME points to same block of memory as *filename which is argv[1]
-  FILE *current_file;
-  current_file = fopen(filename, "r");
-  if (current_file == NULL) {
-    perror("Error opening file");
-    return;
-  }
+  int lines = 0;
+  for(const char *nl = memchr(text, '\n', at); nl != NULL; nl = memchr(nl + 1, '\n', text + at - nl - 1)) lines++;
+  return lines;
+}
 
-  char *line = NULL; //pointer to hold the line read
-  size_t len = 0;   //size of the buffer
-  ssize_t read;      //number of characters read
-  if((read = getline(&line, &len, current_file)) != -1){//do a getline call once without appendRow since a row is appended during initEditor()
-    setChars(E.rows, line, read-1);//-1 to exclude the \n because writeScreen will add it
+void moveCursorTo(int index, int col, int end){
+  /***
+   * Move the cursor to column col of the row at index and scroll so it and the text up to end are in view
+   */
+  E.Cy = index + 1;
+  E.Cx = col + 1;
+  if(index < E.scroll || index >= E.scroll + E.w.ws_row){ //put the match in the middle of the screen
+    E.scroll = index - E.w.ws_row / 2 > 0 ? index - E.w.ws_row / 2 : 0;
   }
-
-  while ((read = getline(&line, &len, current_file)) != -1) {
-    appendRow(); //add a new row
-    setChars(&E.rows[E.numrows-1], line, read-1); //-1 to exclude the \n because writeScreen will add it
+  if(col < E.sidescroll || end > E.sidescroll + E.w.ws_col){
+    E.sidescroll = col - E.w.ws_col / 2 > 0 ? col - E.w.ws_col / 2 : 0;
   }
-  
-  if(E.numrows > 1) setChars(&E.rows[E.numrows-1], line, E.rows[E.numrows-1].length + 1); //add on the last character of the file
-
-  free(line);
-  fclose(current_file); 
 }
 
-void saveFile(void){
+void jumpToMatch(int k){
   /***
-   * Save the contents of the global editor object to a file
+   * Move the cursor to the start of the k'th(0 indexed) match and scroll it into view
    */
-  statusWrite("Filename: ");
-  
-  char filename[MAX_FILENAME];
+  int index, rank, end;
+  rownode *node = findMatchNode(k, &index, &rank);
+  if(node == NULL) return;
+  if(node->r.chars == NULL){ //find which line of the span the match is on
+    const char *text = mapped.data + node->spanStart;
+    index += linesBefore(text, nthMatch(text, node->spanLen, rank, &end));
+  }
+  row *r = rowAt(index); //loading a line of a span splits the span's matches, so the rank is found again
+  int col = nthMatch(searchRowText(r), r->length, k - matchesBeforeRow(index), &end);
+  if(col >= 0) moveCursorTo(index, col, end);
+}
 
-  exitRawMode(); //temporarily turn off RawMode
-  if (fgets(filename, sizeof(filename), stdin) != NULL) {
-    //remove the \n
-    size_t length = strlen(filename);
-    if (length > 0 && filename[length - 1] == '\n') {
-      filename[length - 1] = '\0';
-    }
-    if(strlen(filename) > 256){
-      statusWrite("Filename too large");
-      enableRawMode();
-      E.Cy = E.scroll+1; //snap cursor back to top of screen
-      return;
-    }
-    if(CURRENT_FILENAME == NULL && strlen(filename) == 0){
-      statusWrite("Filename cannot be empty");
-      enableRawMode();
-      E.Cy = E.scroll+1; //snap cursor back to top of screen
-      return;
+int findMatchAhead(size_t budget){
+  /***
+   * Look through the next budget bytes of text for the first match at or after the cursor and move to it, returns 0
+   * if there isn't one that close. Unlike searchNext this reads the text itself, so it works on the rows a background
+   * search hasn't counted yet
+   */
+  int index = E.Cy-1;
+  row *r = rowAt(index);
+  struct match_scan scan;
+  startMatches(&scan, search.regex, searchRowText(r), r->length);
+  while(nextMatch(&scan)){
+    if(scan.start >= (size_t)(E.Cx-1)){
+      moveCursorTo(index, scan.start, scan.end);
+      return 1;
     }
-
-    if(strlen(filename) == 0 && CURRENT_FILENAME != NULL){
-      writeFile(CURRENT_FILENAME);
-    } else if(strlen(filename) > 0){
-      writeFile(filename);
+  }
+  size_t scanned = r->length + 1;
+  rownode *node = rowNodeAt(index);
+  index += node->lines;
+  for(node = nextRowNode(node); node != NULL && scanned < budget; node = nextRowNode(node)){
+    const char *text = node->r.chars == NULL ? mapped.data + node->spanStart : searchRowText(&node->r);
+    size_t len = node->r.chars == NULL ? node->spanLen : (size_t)node->r.length;
+    int end;
+    int at = nthMatch(text, len, 0, &end);
+    if(at >= 0){
+      if(node->r.chars == NULL) index += linesBefore(text, at);
+      r = rowAt(index);
+      moveCursorTo(index, nthMatch(searchRowText(r), r->length, 0, &end), end);
+      return 1;
     }
+    scanned += len + 1;
+    index += node->lines;
   }
-  enableRawMode();
-  E.Cy = E.scroll+1; //snap cursor back to top of screen
+  return 0;
 }
 
-void writeFile(char *filename){
+void searchNext(int forward){
   /***
-   * Write the contents of a file to the screen
+   * Jump to the next match after the cursor, or the one before it if forward is 0. Wraps around the ends of the file
    */
-  FILE *fptr = fopen(filename, "w");
+  int total = nodeMatches(E.rows);
+  if(total == 0) return;
+  row *r = rowAt(E.Cy-1);
+  int before = matchesBeforeRow(E.Cy-1);
+  int k = forward ? before + matchesBeforeColumn(r, E.Cx) : before + matchesBeforeColumn(r, E.Cx-1) - 1;
+  if(k >= total) k = 0;
+  if(k < 0) k = total - 1;
+  jumpToMatch(k);
+}
 
-  if (fptr == NULL) {
-    perror("Error opening file");
-    return;
+void printSearchCount(void){
+  /***
+   * Print which match the cursor is on out of how many there are, next to the cursor position in the status bar
+   */
+  char buf[64];
+  int total = nodeMatches(E.rows);
+  row *r = rowAt(E.Cy-1);
+  int before = matchesBeforeRow(E.Cy-1) + matchesBeforeColumn(r, E.Cx-1);
+  int len;
+  if(before < matchesBeforeRow(E.Cy-1) + matchesBeforeColumn(r, E.Cx)){ //a match starts under the cursor
+    len = snprintf(buf, sizeof(buf), "%d of %d", before + 1, total);
+  } else {
+    len = snprintf(buf, sizeof(buf), "%d match%s", total, total == 1 ? "" : "es");
   }
-
-  for(int i = 0; i < E.numrows - 1; i++){ //write all the chars within rows to the file, note that a \r is NOT written because for some 
-    fprintf(fptr, "%s", E.rows[i].chars); //reason in .txt file land \r is not used, only \n, so we don't add them
-    fprintf(fptr, "%s", "\n");
+  if(searchJob.running){ //the total is still going up
+    snprintf(buf + len, sizeof(buf) - len, ", searching %d%%", (int)((long long)searchJob.progress * 100 / E.numrows));
   }
-  fprintf(fptr, "%s", E.rows[E.numrows-1].chars);
-  
-  long size = getFileSize(fptr);
-  char *bytes_message = malloc(sizeof(long) + 18 + strlen(filename) + 1);
-  sprintf(bytes_message, "%ld bytes written to %s", size, filename);
-  statusWrite(bytes_message);
-
-  fclose(fptr); 
-  free(bytes_message);
+  int x = E.w.ws_col - 23 - (int)strlen(buf) - 2; //left of where printCursorPos puts the cursor position
+  if(x > 0) paintString(E.w.ws_row, x, buf);
 }
 
-long getFileSize(FILE *file){
+void searchHighlight(char *chars){
   /***
-   * Get a file's size in bytes
+   * Highlight the characters the user searched for
    */
-  long size;
-  fseek(file, 0, SEEK_END); //move pointer to end of file
-  size = ftell(file); //get pointer position(this is the file size)
-  fseek(file, 0, SEEK_SET); //move pointer back to beginning of file
-  return size;
+  struct match_scan scan;
+  startMatches(&scan, search.regex, chars, strlen(chars));
+  while(nextMatch(&scan)) addSpan(scan.start, scan.end, HL_MATCH);
 }
 
-char** readTextArray(char* filename){
+/*** Syntax Highlighting***/
+char* highlightText(row *r){
   /***
-   * Read a .txt file into an array
+   * Copy a row's text into the highlighter's scratch space as one string, the gap of the row isn't moved
+   * so highlighting the row being edited doesn't shuffle its characters around
    */
-  //this method assumes the .txt file is in a format where each element of the array is on a separate line
-  FILE *file;
-  if((file = fopen(filename, "r")) == NULL){
-    printf("%s", "Failed to open file");
-    exit(1);
+  if(r->length + 1 > hl.textCapacity){
+    hl.textCapacity = r->length + 1 > 2 * hl.textCapacity ? r->length + 1 : 2 * hl.textCapacity;
+    hl.text = realloc(hl.text, hl.textCapacity);
+    if(hl.text == NULL){
+      printf("Memory allocation failed\n");
+      exit(1);
+    }
   }
-  rewind(file);
-  long start_pos = ftell(file); //get starting position of pointer
-  int lines = 0;
-  char c;
+  memcpy(hl.text, r->chars, r->gapStart);
+  memcpy(hl.text + r->gapStart, r->chars + r->gapEnd, r->length - r->gapStart);
+  hl.text[r->length] = '\0';
+  return hl.text;
+}
 
-  while((c = fgetc(file)) != EOF){ //count the number of lines
-    if(c == '\n'){
-      lines++;
+void addSpan(int start, int end, int style){
+  /***
+   * Add a span of text to draw in style, spans added later are drawn over the ones before them
+   */
+  if(hl.numSpans == hl.spanCapacity){
+    hl.spanCapacity = GROW_CAPACITY(hl.spanCapacity);
+    hl.spans = realloc(hl.spans, sizeof(struct hl_span) * hl.spanCapacity);
+    if(hl.spans == NULL){
+      printf("Memory allocation failed\n");
+      exit(1);
     }
   }
+  hl.spans[hl.numSpans].start = start;
+  hl.spans[hl.numSpans].end = end;
+  hl.spans[hl.numSpans].style = style;
+  hl.numSpans++;
+}
 
-  if(lines > 0 ){ //count the last line which doesn't end with a \n
-    lines++;
+void emitSpans(cell *cells, char *text, int from, int count){
+  /***
+   * Turn count characters of text starting at from into cells colored by the highlighter's spans. Keywords and
+   * comments set the color of the text, search matches set the color behind it
+   */
+  for(int i = 0; i < count; i++){
+    cells[i].ch = cellChar(text[from + i]);
+    cells[i].fg = DEFAULT_COLOR;
+    cells[i].bg = DEFAULT_COLOR;
   }
-
-  fseek(file, start_pos, SEEK_SET); //set file pointer back to beginning of file
-  char **words = malloc(lines * sizeof(char *)); //initialize our array of char pointers
-
-  if(strlen(filename) > 256){
-    printf("%s\n", "File name too large");
-    exit(1);
+  for(int s = 0; s < hl.numSpans; s++){
+    int start = hl.spans[s].start - from;
+    int end = hl.spans[s].end - from;
+    if(start < 0) start = 0;
+    if(end > count) end = count;
+    for(int i = start; i < end; i++){
+      if(hl.spans[s].style == HL_KEYWORD) cells[i].fg = KEYWORD_COLOR;
+      else if(hl.spans[s].style == HL_COMMENT) cells[i].fg = COMMENT_COLOR;
+      else cells[i].bg = MATCH_COLOR;
+    }
   }
+}
 
-  char *line = NULL; //pointer to hold the line read
-  size_t len = 0;   //size of the buffer
-  ssize_t read;      //number of characters read
-  int i = 0;
-  while((read = getline(&line, &len, file)) != -1){
-    words[i] = malloc(read); 
-    strncpy(words[i], line, read - 1);
-    words[i][read - 1] = '\0'; //ensure words[i] is null terminated
-    i++;
+void highlightSyntax(char *chars, int inlineHighlight){
+  /***
+   * Highlight keywords in blue, only keywords before inlineHighlight(where an inline comment starts) are highlighted
+   */
+  int count = matchKeywords(keywords, chars, inlineHighlight);
+  for(int i = 0; i < count; i++){
+    struct keyword_match *match = &keywords->matches[i];
+    addSpan(match->start, match->start + match->length, HL_KEYWORD);
   }
-  free(line);
-  fclose(file);
-  numKeywords = lines;
-  return words;
 }
 
-
-/*** Status Bar Methods ***/
-void statusWrite(char *message){
+void loadKeywords(struct keyword_table *table, const char *name){
   /***
-   * Write a message to the special status bar
+   * Set up the keyword table for the keyword file called name, a file of that name in the directory
+   * NOTEPADMM_KEYWORDS points at takes the place of the one built into the editor. A NULL name or a
+   * name with no keyword set leaves the table empty
    */
-  E.Cy = E.w.ws_row + E.scroll + 1; //snap cursor to the lowest row reserved for status messsages
-  E.Cx = E.sidescroll+1;
-  cursor_move_cmd(); //move the cursor
-  
-  write(STDOUT_FILENO, "\x1b[2K", 4); //clear the special row
-  write(STDOUT_FILENO, message, strlen(message)); //write the message to the special row
+  memset(table, 0, sizeof(*table));
+  if(name == NULL) return;
+  char *dir = getenv("NOTEPADMM_KEYWORDS");
+  if(dir != NULL){
+    char path[MAX_FILENAME + 64];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    table->fileWords = readKeywordFile(path, &table->numFileWords);
+    if(table->fileWords != NULL && !buildKeywordSet(table->fileWords, table->numFileWords, &table->set)){
+      freeKeywordTable(table); //fall back on the built in set
+    }
+  }
+  for(int i = 0; i < numBuiltinKeywordSets && table->fileWords == NULL; i++){
+    if(strcmp(builtinKeywordSets[i].name, name) == 0) table->set = builtinKeywordSets[i];
+  }
+  for(int i = 0; i < table->set.numOperators; i++){
+    table->operatorStart[(unsigned char)table->set.operators[i][0]] = 1;
+  }
+}
 
+void freeKeywordTable(struct keyword_table *table){
+  /***
+   * Free the keyword table, a built in set has nothing to free
+   */
+  if(table->fileWords != NULL){
+    freeKeywordSet(&table->set);
+    for(int i = 0; i < table->numFileWords; i++) free(table->fileWords[i]);
+    free(table->fileWords);
+  }
+  free(table->matches);
+  memset(table, 0, sizeof(*table));
 }
 
-/*** Searching Methods ***/
-void searchHighlight(char **chars, int commentIndex, int multiline){
+void addKeywordMatch(struct keyword_table *table, int count, int start, int length){
   /***
-   * Highlight the characters the user searched for
+   * Record the count'th keyword match of a row
    */
-  char *foundWord;
-  int index = 0;
-  int searchOffset = 0;
-  if(*chars != NULL){
-    if(searchQuery != NULL){
-      foundWord = strstr(*chars + index + searchOffset, searchQuery);
-      while(foundWord != NULL){
-        searchOffset = strlen(searchQuery);
-        index = foundWord - *chars;
-        if(foundWord != NULL) {
-          insertStr(chars, "\x1b[48;5;160m", index);
-          if(index > commentIndex || multiline){
-            insertStr(chars, "\x1b[0m\x1b[38;5;22m", index + 11 + strlen(searchQuery));
-          } else {
-            insertStr(chars, "\x1b[0m", index + 11 + strlen(searchQuery));
-          }
-          foundWord = strstr(*chars + index + searchOffset + 15, searchQuery);
-        }
-      }
+  if(count == table->matchCapacity){
+    table->matchCapacity = GROW_CAPACITY(table->matchCapacity);
+    table->matches = realloc(table->matches, sizeof(struct keyword_match) * table->matchCapacity);
+    if(table->matches == NULL){
+      printf("Memory allocation failed\n");
+      exit(1);
     }
   }
+  table->matches[count].start = start;
+  table->matches[count].length = length;
 }
 
-/*** Syntax Highlighting***/
-void highlightSyntax(char **chars, int inlineHighlight){
-  /***
-   * Highlight keywords in blue
-   */
-  int indicesLen = 0;
-  //find the number of keywords in a line
-  int keywordCount = 0;
-  char* foundWord;
-  if(*chars != NULL){
-    for(int i = 0; i < numKeywords; i++){
-      foundWord = strstr(*chars, keywords[i]);
-      while(foundWord != NULL){
-        keywordCount++;
-        int index = foundWord - *chars;
-        indicesLen++;
-        if(checkKeywordHighlight(*chars, foundWord, strlen(keywords[i])) && index < inlineHighlight){
-          insertStr(chars, "\x1b[38;5;26m", index);
-          insertStr(chars, "\x1b[0m", index + 10 + strlen(keywords[i]));
-          inlineHighlight += 14;
-          foundWord = strstr(*chars + index + 14 + strlen(keywords[i]), keywords[i]);
-        } else{
-          foundWord = strstr(*chars + index + strlen(keywords[i]), keywords[i]);
+int matchKeywords(struct keyword_table *table, char *chars, int limit){
+  /***
+   * Find the keywords that start before limit in chars with a single pass over it, the matches are left in
+   * table->matches in order and their number is returned. Every identifier is looked up whole, so a keyword
+   * inside a longer name isn't matched. Operator keywords just can't have a letter right before or after them
+   */
+  int count = 0;
+  int i = 0;
+  while(chars[i] != '\0' && i < limit){
+    if(isWordChar(chars[i])){
+      int end = i + 1;
+      while(isWordChar(chars[end])) end++;
+      if(keywordSetContains(&table->set, chars + i, end - i)) addKeywordMatch(table, count++, i, end - i);
+      i = end;
+      continue;
+    }
+    if(table->operatorStart[(unsigned char)chars[i]]){
+      int matched = 0;
+      for(int j = 0; j < table->set.numOperators && !matched; j++){
+        int len = strlen(table->set.operators[j]);
+        if(strncmp(chars + i, table->set.operators[j], len) == 0 && checkKeywordHighlight(chars, chars + i, len)){
+          addKeywordMatch(table, count++, i, len);
+          matched = len;
         }
       }
+      if(matched){
+        i += matched;
+        continue;
+      }
     }
+    i++;
   }
+  return count;
+}
+
+int inlineCommentHighlight(char *chars){
+  /***
+   * Changes inline comments to green, returns where the comment starts
+   */
+  char *foundWord = strstr(chars, "//");
+  if(foundWord == NULL) return 8000;
+  int index = foundWord - chars;
+  addSpan(index, index + strlen(foundWord), HL_COMMENT);
+  return index;
+}
+
+void multilineCommentHighlight(char *chars){
+  /***
+   * Handles making green rows that are included in multiline comments
+   */
+  char *foundWord = strstr(chars, "/*");
+  int index = foundWord != NULL ? foundWord - chars : 0;
+  addSpan(index, strlen(chars), HL_COMMENT);
+}
+
+void commentsChanged(int index){
+  /***
+   * Note that the row at index changed or was added or removed, so the multiline comment state of the rows
+   * from index on has to be checked again
+   */
+  if(index < E.commentFrom) E.commentFrom = index;
+  if(index > E.commentTo) E.commentTo = index;
 }
 
-int inlineCommentHighlight(char **chars){
+int lexComment(row *r, int in, int *opened){
   /***
-   * Changes inline comments to green
+   * Go through a row that starts inside a multiline comment if in is 1, and return whether the row after it
+   * does. opened is set to 1 if a multiline comment starts in this row. A // outside of a multiline comment
+   * ends the row's code, so a comment opener after it doesn't start anything
    */
-  char* foundWord;
-  if(*chars != NULL){ 
-    foundWord = strstr(*chars, "//");
-    if(foundWord != NULL){
-      int index = foundWord - *chars;
-      insertStr(chars, "\x1b[38;5;22m", index);
-      insertStr(chars, "\x1b[0m", strlen(*chars));
-      return index;
+  char prev = '\0';
+  int gapLen = r->gapEnd - r->gapStart;
+  *opened = 0;
+  for(int i = 0; i < r->length; i++){
+    char c = r->chars[i < r->gapStart ? i : i + gapLen]; //read around the gap instead of moving it
+    if(in && prev == '*' && c == '/'){
+      in = 0;
+      c = '\0'; //the / can't start another comment
+    } else if(!in && prev == '/' && c == '*'){
+      in = 1;
+      *opened = 1;
+      c = '\0'; //the * can't end the comment it just started
+    } else if(!in && prev == '/' && c == '/'){
+      break;
     }
+    prev = c;
   }
-  return 8000;
+  return in;
 }
 
-void multilineCommentHighlight(char **chars){
+void settleComments(int end){
   /***
-   * Handles making green rows that are included in multiline comments
+   * Bring the commentIn of the rows up to date, starting from the first row that may be out of date. The
+   * walk stops as soon as it is past every changed row and finds a row that already had the right state,
+   * since nothing below that can have changed. It also stops at end, the rest is left for when those
+   * rows are shown, so an edit only costs as much as the rows it actually affects up to the screen's bottom
    */
-  char* foundWord;
-  if(*chars != NULL){
-    foundWord = strstr(*chars, "/*");
-    if(foundWord != NULL){
-      int index = foundWord - *chars;
-      insertStr(chars, "\x1b[38;5;22m", index);
-      insertStr(chars, "\x1b[0m", strlen(*chars));
-    } else {
-      insertStr(chars, "\x1b[38;5;22m", 0);
-      insertStr(chars, "\x1b[0m", strlen(*chars));
+  if(E.commentFrom >= E.numrows){
+    E.commentFrom = INT_MAX;
+    E.commentTo = -1;
+    return;
+  }
+  if(E.commentFrom >= end) return;
+
+  int offset = 0;
+  rownode *node = findRowNode(E.commentFrom, &offset);
+  int i = E.commentFrom - offset; //first row of the node
+  int state = 0;
+  int opened;
+  if(i > 0){ //pick up the state the row above leaves, that row is up to date
+    int aboveOffset;
+    rownode *above = findRowNode(i - 1, &aboveOffset);
+    state = above->r.chars == NULL ? above->commentIn : lexComment(&above->r, above->commentIn, &opened);
+  }
+  for(; node != NULL; i += node->lines, node = nextRowNode(node)){
+    if(i > E.commentTo && node->commentIn == state){ //settled, every row from here on is still right
+      E.commentFrom = INT_MAX;
+      E.commentTo = -1;
+      return;
+    }
+    if(i >= end){ //the rest isn't on screen yet
+      E.commentFrom = i;
+      return;
     }
+    node->commentIn = state;
+    if(node->r.chars != NULL) state = lexComment(&node->r, state, &opened); //an unloaded span keeps the state
   }
+  E.commentFrom = INT_MAX;
+  E.commentTo = -1;
 }
 
-int* markMultilineRows(void){
+int* markMultilineRows(int start, int count){
   /*
    *This method will create an int array where each entry is a 1 or a 0 denoting whether or not
-   *the corresponding row in the global editor object E is included in a multiline comment
+   *the rows start to start + count - 1 in the global editor object E are included in a multiline comment.
+   *Lines of a memory mapped file that haven't been loaded yet are treated as not containing comments.
+   *The array comes from the frame arena and is good until the next frame starts
    */
-  int *markedRows = malloc(E.numrows * sizeof(int)); 
-  int mark_on = 0;
-  char *foundWord;
-  for(int i = 0; i < E.numrows; i++){
-    if((foundWord = strstr(E.rows[i].chars, "/*")) != NULL){
-      mark_on = 1;
-    }
-    if(mark_on){
-      markedRows[i] = 1;
-    } else {
-      markedRows[i] = 0;
-    }
-    if((foundWord = strstr(E.rows[i].chars, "*/")) != NULL){
-      mark_on = 0;
+  int *markedRows = arenaAlloc(count * sizeof(int));
+  settleComments(start + count);
+  int offset = 0;
+  rownode *node = findRowNode(start, &offset);
+  int i = start - offset;
+  for(; node != NULL && i < start + count; i += node->lines, node = nextRowNode(node)){
+    int opened = 0;
+    if(node->r.chars != NULL) lexComment(&node->r, node->commentIn, &opened);
+    for(int j = i; j < i + node->lines; j++){ //every line of an unloaded span gets the state it started with
+      if(j >= start && j < start + count) markedRows[j - start] = node->commentIn || opened;
     }
   }
   return markedRows;
 }
 
-void commentEntireRow(char **chars){
+int setLanguage(char *filename){
+  /***
+   * Highlight the current buffer with the keywords of filename's language, the way a file of that name would be.
+   * Returns how many keywords the language has
+   */
+  keywords = languageFor(filename);
+  return keywords->set.numWords + keywords->set.numOperators;
+}
+
+int countKeywords(char *chars){
   /***
-   * Make an entire row green to denote it is commented out
+   * Count the keywords of the current language in chars
    */
-  insertStr(chars, "\x1b[38;5;22m", 0);
-  insertStr(chars, "\x1b[0m", strlen(*chars));
+  return matchKeywords(keywords, chars, INT_MAX);
 }
 
 int checkKeywordHighlight(char *fullLine, char *word, int wordlen){
@@ -1270,31 +5051,334 @@ int checkKeywordHighlight(char *fullLine, char *word, int wordlen){
   return passed;
 }
 
+/*** Frame Profiling ***/
+int compareDoubles(const void *a, const void *b){
+  /***
+   * qsort comparison for doubles, smallest first
+   */
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+void initProfile(void){
+  /***
+   * Open the trace file if NOTEPADMM_TRACE names one. It is a Chrome trace event file(chrome://tracing or
+   * ui.perfetto.dev), a JSON array that closeTrace() ends
+   */
+  prof.origin = nowSeconds();
+  prof.phase = PHASE_NONE;
+  prof.frameBytes = cbuf.totalBytes;
+  char *trace = getenv("NOTEPADMM_TRACE");
+  prof.trace = trace != NULL ? fopen(trace, "w") : NULL; //no trace rather than no editor if it can't be opened
+  if(prof.trace != NULL) fputs("[\n", prof.trace);
+}
+
+void closeTrace(void){
+  /***
+   * End the trace file's array and close it, a trace cut off without this still loads in chrome://tracing
+   */
+  if(prof.trace != NULL){
+    fputs("\n]\n", prof.trace);
+    fclose(prof.trace);
+    prof.trace = NULL;
+  }
+  free(prof.spans);
+  prof.spans = NULL;
+  prof.numSpans = prof.spanCapacity = 0;
+}
+
+void toggleFrameTimes(void){
+  /***
+   * Show or hide the last and p99 frame times in the status bar, they start over each time they are shown
+   */
+  prof.hud = !prof.hud;
+  if(prof.hud){
+    prof.numFrames = 0;
+    if(prof.trace == NULL){ //nothing was being timed, start the next frame fresh
+      prof.numSpans = 0;
+      prof.phase = PHASE_NONE;
+    }
+  }
+}
+
+void profilePhase(int phase){
+  /***
+   * End the phase being timed and start timing phase instead, PHASE_NONE just ends it. Does nothing unless the frame
+   * times are shown or traced
+   */
+  if(!prof.hud && prof.trace == NULL) return;
+  double now = nowSeconds();
+  if(prof.phase != PHASE_NONE){
+    if(prof.numSpans == prof.spanCapacity){
+      prof.spanCapacity = GROW_CAPACITY(prof.spanCapacity);
+      prof.spans = realloc(prof.spans, sizeof(struct frame_span) * prof.spanCapacity);
+      if(prof.spans == NULL){
+        printf("Memory allocation failed\n");
+        exit(1);
+      }
+    }
+    prof.spans[prof.numSpans++] = (struct frame_span){prof.phase, prof.phaseStart, now};
+  }
+  prof.phase = phase;
+  prof.phaseStart = now;
+}
+
+void endFrame(void){
+  /***
+   * A frame was just drawn, add up the time its phases took and write them to the trace. The frame's time is only the
+   * time spent in its phases, not the time spent waiting for keys or for the frame rate cap
+   */
+  if(!prof.hud && prof.trace == NULL) return;
+  profilePhase(PHASE_NONE);
+  double busy = 0;
+  for(int i = 0; i < prof.numSpans; i++) busy += prof.spans[i].end - prof.spans[i].start;
+  prof.last = busy;
+  prof.history[prof.numFrames++ % FRAME_HISTORY] = busy;
+  if(prof.hud){
+    double sorted[FRAME_HISTORY];
+    int n = prof.numFrames < FRAME_HISTORY ? prof.numFrames : FRAME_HISTORY;
+    memcpy(sorted, prof.history, sizeof(double) * n);
+    qsort(sorted, n, sizeof(double), compareDoubles);
+    prof.p99 = sorted[n * 99 / 100];
+  }
+  if(prof.trace != NULL && prof.numSpans > 0) traceFrame(busy);
+  prof.frameBytes = cbuf.totalBytes;
+  prof.numSpans = 0;
+}
+
+void traceFrame(double busy){
+  /***
+   * Write the frame that was just drawn to the trace, as a frame event from its first phase to its last with each
+   * phase under it. Times are in microseconds since the editor started
+   */
+  static const char *names[] = {"input", "edit", "highlight", "compose", "write"};
+  struct frame_span *first = &prof.spans[0];
+  struct frame_span *last = &prof.spans[prof.numSpans - 1];
+  fprintf(prof.trace, "%s{\"name\": \"frame\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, \"pid\": 1, \"tid\": 1, "
+          "\"args\": {\"busy_us\": %.3f, \"bytes\": %lld}}", prof.traceEvents++ > 0 ? ",\n" : "",
+          (first->start - prof.origin) * 1e6, (last->end - first->start) * 1e6, busy * 1e6,
+          cbuf.totalBytes - prof.frameBytes);
+  for(int i = 0; i < prof.numSpans; i++){
+    struct frame_span *span = &prof.spans[i];
+    fprintf(prof.trace, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, \"pid\": 1, \"tid\": 1}",
+            names[span->phase], (span->start - prof.origin) * 1e6, (span->end - span->start) * 1e6);
+    prof.traceEvents++;
+  }
+}
+
 /*** Main Loop ***/
-int main(int argc, char *argv[]){
+void runEditor(void){
+  /***
+   * Edit the text in the terminal until the user presses ctrl+c, then put the terminal back the way it was.
+   * Everything since the last frame is handled as one batch and drawn as one frame
+   */
+  cbuf.sink = 0;
   enableRawMode();
-  if(argc == 2){
-    initEditor(argv[1]);
-  } else {
-    initEditor("hello_world.c");
+  resizeEditor(); //the editor may have been opened without looking at the terminal
+  clearScreen();
+  initEventLoop();
+  loop.quit = 0;
+  loop.lastFrame = nowSeconds();
+  writeScreen();
+  while(!loop.quit){
+    int timeout = -1; //nothing to do until something happens
+    if(searchJob.running || saveJob->running) timeout = SEARCH_REFRESH; //show the background jobs' progress
+    if(input.start < input.length) timeout = ESCAPE_WAIT; //the rest of an escape sequence should be on its way
+    if(loop.frameDue){ //a frame is being held back by the frame rate cap
+      int wait = (int)((loop.lastFrame + loop.frameInterval - nowSeconds()) * 1000) + 1;
+      if(timeout < 0 || wait < timeout) timeout = wait > 0 ? wait : 0;
+    }
+    waitForEvents(timeout);
+    if(saveJob->running) loop.frameDue = 1; //its progress, or how it went if it's done now
+    applySaveResult();
+    if(input.start < input.length) profilePhase(PHASE_EDIT);
+    if(processInput(nowSeconds() - loop.lastInput >= ESCAPE_WAIT / 1000.0)) loop.frameDue = 1;
+    if(loop.quit) break;
+    applySearchResults();
+    syncMappedRows(); //pick up any lines the indexer found in the meantime
+    if(searchFlag && search.uncounted) searchInBackground();
+    profilePhase(PHASE_NONE); //waiting for the next event isn't part of a frame
+    if(searchJob.running) loop.frameDue = 1;
+    double now = nowSeconds();
+    if(loop.frameDue && now - loop.lastFrame >= loop.frameInterval){ //one frame for everything since the last one
+      scrollCheck();
+      sidescrollCheck();
+      writeScreen();
+      loop.frameDue = 0;
+      loop.lastFrame = now;
+    }
   }
-  if(argc == 2){
-    char *filename = argv[1];
-    readFile(filename);
-    clearScreen();
-    writeScreen();
+  waitForSave(); //a save that was started should finish before the editor goes away
+  add_cmd("\x1b[2J", 0); //clear entire screen
+  add_cmd("\x1b[f", 0);  //move cursor to top left of screen
+  writeCmds();
+  exitRawMode();
+  printOutputStats();
+  close(loop.resizePipe[0]);
+  close(loop.resizePipe[1]);
+  signal(SIGWINCH, SIG_DFL);
+  if(loop.recordFd != -1) close(loop.recordFd);
+}
+
+/*** Library Interface ***/
+struct nmm_editor {
+  /***
+   * An editor opened with nmmOpen(). What it edits is kept in the editor's globals, so there is only ever one open
+   * and every function checks that it's given that one
+   * 1. buffers - The files open in it
+   */
+  struct buffer_list *buffers;
+};
+
+nmm_editor *openEditor; //The editor that is open, NULL if there isn't one
+
+nmm_editor* nmmOpen(const char *filename){
+  /***
+   * Open filename for editing, a file that doesn't exist yet starts out empty. A NULL filename opens a new file
+   * that gets a name when it's saved. Nothing is drawn until nmmRun(). Returns NULL if an editor is already open
+   */
+  if(openEditor != NULL) return NULL;
+  nmm_editor *ed = malloc(sizeof(nmm_editor));
+  if(ed == NULL){
+    printf("Memory allocation failed\n");
+    exit(1);
   }
+  ed->buffers = &buffers;
+  cbuf.sink = 1; //frames go nowhere until nmmRun() puts the editor on the terminal
+  initScreen();
+  openBuffer(filename);
+  openEditor = ed;
+  return ed;
+}
 
-  //readFile("hello_world.c");  //for debug purposes only
-  //clearScreen();
-  //writeScreen();
+void nmmClose(nmm_editor *ed){
+  /***
+   * Close an editor without saving it, waiting for a save that is still running
+   */
+  if(ed == NULL || ed != openEditor) return;
+  freeEditor();
+  free(ed);
+  openEditor = NULL;
+}
 
-  while(1){ 
-    char c = processKeypress();
-    sortKeypress(c);
-    clearScreen();
-    scrollCheck();
-    sidescrollCheck();
-    writeScreen();
+int nmmOpenBuffer(nmm_editor *ed, const char *filename){
+  /***
+   * Open another file in the editor and make it the current buffer, the other functions all work on the current
+   * one. A NULL filename is a new file. Returns the new buffer's index, the first file opened is 0, or -1 if ed
+   * isn't open
+   */
+  if(ed == NULL || ed != openEditor) return -1;
+  return openBuffer(filename);
+}
+
+int nmmSwitchBuffer(nmm_editor *ed, int index){
+  /***
+   * Make the buffer at index the current buffer, returns 0 or -1 if there's no such buffer
+   */
+  if(ed == NULL || ed != openEditor) return -1;
+  if(index < 0 || index >= ed->buffers->numBuffers) return -1;
+  switchBuffer(index);
+  return 0;
+}
+
+int nmmLineCount(nmm_editor *ed){
+  /***
+   * Returns how many lines the text has, a file that is still being indexed is indexed all the way first. Returns -1
+   * if ed isn't open
+   */
+  if(ed == NULL || ed != openEditor) return -1;
+  finishMappedFile();
+  return E.numrows;
+}
+
+int nmmGetLine(nmm_editor *ed, int line, char *buf, int size){
+  /***
+   * Copy line into buf as a string, cut short to fit in size bytes. Returns the line's whole length, or -1 if
+   * there is no such line or ed isn't open. A file that is still being indexed is only indexed as far as line
+   */
+  if(ed == NULL || ed != openEditor) return -1;
+  syncMappedRowsTo(line);
+  if(line < 0 || line >= E.numrows) return -1;
+  row *r = rowAt(line);
+  if(size <= 0) return r->length;
+  int n = r->length < size - 1 ? r->length : size - 1;
+  rowCopy(r, 0, n, buf);
+  buf[n] = '\0';
+  return r->length;
+}
+
+int nmmApplyEdits(nmm_editor *ed, const struct nmm_edit *edits, int count){
+  /***
+   * Make count edits in one pass, see applyEdits(). Returns 0, or -1 if they weren't all in order and inside the text
+   * or ed isn't open
+   */
+  if(ed == NULL || ed != openEditor) return -1;
+  return applyEdits(edits, count, NULL, NULL);
+}
+
+int nmmTypeKeys(nmm_editor *ed, const char *keys, int length){
+  /***
+   * Handle length bytes of keys as if they had been typed in the terminal, escape sequences and bracketed pastes
+   * included, see replayKey(). ctrl+s is skipped and ctrl+c drops the rest of the keys. Returns 0, or -1 if ed
+   * isn't open
+   */
+  if(ed == NULL || ed != openEditor || keys == NULL || length < 0) return -1;
+  feedKeys(keys, length);
+  while(replayKey());
+  return 0;
+}
+
+int nmmUndo(nmm_editor *ed){
+  /***
+   * Undo the last edit or batch of edits, returns 1, 0 if there was nothing to undo, or -1 if ed isn't open
+   */
+  if(ed == NULL || ed != openEditor) return -1;
+  if(journal.current == 0) return 0;
+  undoEdit();
+  return 1;
+}
+
+int nmmRedo(nmm_editor *ed){
+  /***
+   * Redo the last undone edit or batch of edits, returns 1, 0 if there was nothing to redo, or -1 if ed isn't open
+   */
+  if(ed == NULL || ed != openEditor) return -1;
+  if(journal.current == journal.numEntries) return 0;
+  redoEdit();
+  return 1;
+}
+
+int nmmSave(nmm_editor *ed, const char *filename){
+  /***
+   * Save the current buffer to filename, or to the file it was opened on if it's NULL, and wait for it to be on disk.
+   * Returns 0, or -1 with errno set if it couldn't be saved
+   */
+  if(filename == NULL) filename = CURRENT_FILENAME;
+  if(ed == NULL || ed != openEditor || filename == NULL){
+    errno = EINVAL;
+    return -1;
   }
-}
\ No newline at end of file
+  if(writeFile((char *)filename) == -1) return -1; //the temp file couldn't be made, errno says why
+  waitForSave();
+  if(saveJob->error == 0) return 0;
+  errno = saveJob->error;
+  return -1;
+}
+
+int nmmModified(nmm_editor *ed){
+  /***
+   * Returns 1 if the current buffer has edits that aren't saved, 0 if it doesn't, or -1 if ed isn't open
+   */
+  if(ed == NULL || ed != openEditor) return -1;
+  return E.changes != E.savedChanges;
+}
+
+int nmmRun(nmm_editor *ed){
+  /***
+   * Let the user edit the text in the terminal until they press ctrl+c, returns 0 once they have or -1 if ed isn't open
+   */
+  if(ed == NULL || ed != openEditor) return -1;
+  runEditor();
+  return 0;
+}
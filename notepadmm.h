@@ -3,43 +3,131 @@
 #include <stdio.h>
 
 void add_cmd(char *, int);
+void add_bytes(char *, int);
 void writeCmds(void);
+void printOutputStats(void);
+void outputTotals(long long *, long long *);
 void getWinSize(void);
-void initEditor(char *);
+void resizeEditor(void);
+void initScreen(void);
+void initBuffer(char *);
+void freeLanguages(void);
+int openBuffer(const char *);
+void switchBuffer(int);
+void nextBuffer(void);
+void freeBuffer(void);
 void exitRawMode(void);
 void enableRawMode(void);
 void appendRow(void);
-void shiftRowsDown(int);
+int rowCount(void);
 void cursor_move_cmd(void);
 void incrementCursor(int, int, int, int);
 void moveCursor(char *);
 void addPrintableChar(char);
 void backspacePrintableChar(void);
 void deletePrintableChar(void);
-void sortEscapes(char);
+void sortEscapes(char *, int);
 void addRow(void);
+void splitRowAt(int, int);
+void insertText(int, int, const char *, int, int *, int *);
+void deleteText(int, int, int, char *);
+void initJournal(void);
+size_t journalBytes(void);
+void appendUndoText(const char *, int);
+void trimJournal(void);
+void recordInsert(int, int, const char *, int);
+void recordDelete(int, int, const char *, int);
+void journalStatus(const char *);
+void undoEdit(void);
+void redoEdit(void);
 void sortKeypress(char);
-char processKeypress(void);
+void freeEditor(void);
 void clearScreen(void);
+void* arenaAlloc(size_t);
+void resetArena(void);
+void initGrid(void);
+void clearGrid(void);
+char cellChar(char);
+int paintString(int, int, char *);
+void flushGrid(void);
+void initHighlightCache(void);
+void clearHighlightCache(void);
 void writeScreen(void);
 void removeRow(int);
 void free_all_rows(void);
+void rowEdited(int);
+void releaseOrphans(void);
 void readFile(char *);
+char* readWholeFile(char *, size_t *);
+size_t countNewlines(const char *, size_t);
+int loadRows(char *);
 void saveFile(void);
-void writeFile(char *);
-void statusWrite(char *);
-long getFileSize(FILE *);
+void closeSavePrompt(int);
+int writeFile(char *);
+void* saveWorker(void *);
+void applySaveResult(void);
+void endSave(void);
+void waitForSave(void);
+void scrollCheck(void);
+void sidescrollCheck(void);
 void scrollRight(void);
 void scrollLeft(void);
-void searchHighlight(char **, int, int);
-void searchPrompt(void);
-void highlightSyntax(char **, int);
-char** readTextArray(char *);
-int inlineCommentHighlight(char **);
-void multilineCommentHighlight(char **);
-int* markMultilineRows(void);
-void commentEntireRow(char **);
+const char* compileSearch(int);
+const char* setSearchQuery(const char *, int);
+int countQueryMatches(const char *, size_t);
+const char* findMatch(const char *, size_t);
+int nthMatch(const char *, size_t, int, int *);
+int matchesBeforeRow(int);
+int linesBefore(const char *, int);
+void moveCursorTo(int, int, int);
+void jumpToMatch(int);
+int findMatchAhead(size_t);
+void searchNext(int);
+void printSearchCount(void);
+void* searchWorker(void *);
+void applyPieces(size_t);
+void applySearchResults(void);
+void stopSearchJob(void);
+void startSearch(int);
+void searchInBackground(void);
+void onResize(int);
+void initEventLoop(void);
+ssize_t readTerminal(char *, size_t);
+void feedKeys(const char *, size_t);
+int replayKey(void);
+int waitForEvents(int);
+int keyLength(int);
+void handleKey(char *, int);
+int processInput(int);
+char* readPaste(int *);
+void pasteText(void);
+void promptPaste(void);
+void searchHighlight(char *);
+void openPrompt(int);
+void promptSearch(void);
+void promptJump(void);
+void closePrompt(int);
+void promptChanged(void);
+void promptKeypress(char);
+void highlightSyntax(char *, int);
+void addSpan(int, int, int);
+int inlineCommentHighlight(char *);
+void multilineCommentHighlight(char *);
+void commentsChanged(int);
+void settleComments(int);
+int* markMultilineRows(int, int);
 int checkKeywordHighlight(char *, char *, int);
+int setLanguage(char *);
+int countKeywords(char *);
 void printCursorPos(void);
+int compareDoubles(const void *, const void *);
+void initProfile(void);
+void closeTrace(void);
+void toggleFrameTimes(void);
+void profilePhase(int);
+void endFrame(void);
+void traceFrame(double);
+double nowSeconds(void);
+void runEditor(void);
 
-#endif
\ No newline at end of file
+#endif
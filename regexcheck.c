@@ -0,0 +1,211 @@
+/***
+ * regexcheck
+ * Checks the search's regex engine, make check runs it. A table of patterns and texts is run through
+ * regexMarkStarts and regexNext and the matches are compared with the ones written down for them, then random
+ * patterns and texts are compared with what the C library's POSIX regex finds for them
+ * Usage: regexcheck [seed]
+ */
+
+/*** Includes ***/
+#include "regexdfa.h"
+#include <regex.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*** Defines ***/
+#define MAX_RESULT 1024 //room for the matches of one text written out
+#define RANDOM_CASES 20000 //random patterns compared with the C library
+#define RANDOM_TEXT 40 //longest random text
+
+/*** Data ***/
+struct regex_case {
+  /***
+   * A pattern, a text, and the matches expected in it written as start-end byte offsets separated by commas, ""
+   * if there are none. A pattern that shouldn't compile expects the error it should give instead
+   */
+  const char *pattern;
+  const char *text;
+  const char *expected;
+};
+
+static const struct regex_case cases[] = {
+  {"abc", "xabcabc", "1-4,4-7"},
+  {"a", "", ""},
+  {"a*", "baaab", "1-4"}, //empty matches are skipped
+  {"a+b", "aab ab b", "0-3,4-6"},
+  {"colou?r", "color colour colouur", "0-5,6-12"},
+  {"cat|dog", "hotdog catalog", "3-6,7-10"},
+  {"a|ab", "abab", "0-2,2-4"}, //the longest match at the first start
+  {"(ab)+", "ababab abx", "0-6,7-9"},
+  {"(a|b)*c", "abacbc", "0-4,4-6"},
+  {"x*y", "xxy y", "0-3,4-5"},
+  {"a.c", "abc a\nc aXc", "0-3,8-11"}, //. doesn't match a \n
+  {"a.*b", "ab\nab", "0-2,3-5"}, //matches don't cross lines
+  {"[a-c]+", "xxabcdcba", "2-5,6-9"},
+  {"[^0-9 ]+", "ab12 cd", "0-2,5-7"},
+  {"[]a]+", "x]a]x", "1-4"}, //a ] right after the [ is part of the class
+  {"[a-]+", "b-a-b", "1-4"},
+  {"[.]", "a.b", "1-2"},
+  {"\\.", "a.b", "1-2"},
+  {"\\d+", "a1b22c333", "1-2,3-5,6-9"},
+  {"\\D+", "a1b22c333", "0-1,2-3,5-6"},
+  {"\\w+", "foo_bar, baz9!", "0-7,9-13"},
+  {"\\W", "a, b", "1-2,2-3"},
+  {"\\s", "a b\tc", "1-2,3-4"},
+  {"\\S+", "  ab c", "2-4,5-6"},
+  {"[\\d_]+", "a1_2b", "1-4"},
+  {"\\t", "a\tb", "1-2"},
+  {"^ab", "ab ab\nab", "0-2,6-8"},
+  {"ab$", "ab ab\nab", "3-5,6-8"},
+  {"^$", "a\n\nb", ""},
+  {"^a*$", "aa\nab\n\naaa", "0-2,7-10"},
+  {"(^a|b)", "aab\nab", "0-1,2-3,4-5,5-6"},
+  {"(a", "", "missing )"},
+  {"ab)", "", "unmatched )"},
+  {"[ab", "", "missing ]"},
+  {"*a", "", "nothing to repeat"},
+  {"a|+", "", "nothing to repeat"},
+  {"ab\\", "", "pattern ends with \\"},
+};
+
+/*** Matching ***/
+int findMatches(const char *pattern, const char *text, char *result, size_t size){
+  /***
+   * Write every match of pattern in text into result the way the table writes them, or the error if the pattern
+   * doesn't compile. Returns 0 if it compiled
+   */
+  const char *error = NULL;
+  struct regex *re = regexCompile(pattern, &error);
+  if(re == NULL){
+    snprintf(result, size, "%s", error);
+    return -1;
+  }
+  size_t len = strlen(text);
+  size_t from = 0, start, end, used = 0;
+  result[0] = '\0';
+  regexMarkStarts(re, text, len);
+  while(regexNext(re, text, len, from, &start, &end)){
+    used += snprintf(result + used, size - used, used == 0 ? "%zu-%zu" : ",%zu-%zu", start, end);
+    if(used >= size) break;
+    from = end;
+  }
+  regexFree(re);
+  return 0;
+}
+
+int longestAt(regex_t *posix, const char *line, size_t at){
+  /***
+   * Length of the longest match of the POSIX regex that starts right at the byte at, -1 if there isn't one. A
+   * POSIX match is the leftmost and then the longest, so one that starts at the first byte is the longest there
+   */
+  regmatch_t match;
+  if(regexec(posix, line + at, 1, &match, at > 0 ? REG_NOTBOL : 0) != 0 || match.rm_so != 0) return -1;
+  return match.rm_eo;
+}
+
+void posixMatches(regex_t *posix, const char *text, char *result, size_t size){
+  /***
+   * Write the matches regexNext should find in text, worked out one line at a time with the C library: the
+   * longest match at the first byte that starts a non empty one, then the same again from where it ends
+   */
+  char line[RANDOM_TEXT + 1];
+  size_t used = 0;
+  result[0] = '\0';
+  for(size_t lineStart = 0; ; ){
+    size_t lineLen = strcspn(text + lineStart, "\n");
+    memcpy(line, text + lineStart, lineLen);
+    line[lineLen] = '\0';
+    for(size_t at = 0; at < lineLen; ){
+      int length = longestAt(posix, line, at);
+      if(length <= 0){
+        at++;
+        continue;
+      }
+      used += snprintf(result + used, size - used, used == 0 ? "%zu-%zu" : ",%zu-%zu", lineStart + at,
+                       lineStart + at + length);
+      at += length;
+    }
+    if(text[lineStart + lineLen] == '\0') break;
+    lineStart += lineLen + 1;
+  }
+}
+
+/*** Random Cases ***/
+void randomPattern(char *out, size_t *used, int depth){
+  /***
+   * Append a random pattern over a and b to out, one both engines read the same way
+   */
+  static const char *const atoms[] = {"a", "b", ".", "[ab]", "[^a]", "[a-b]"};
+  int branches = rand() % 4 == 0 ? 2 : 1;
+  for(int branch = 0; branch < branches; branch++){
+    if(branch > 0) out[(*used)++] = '|';
+    int pieces = 1 + rand() % 3;
+    for(int piece = 0; piece < pieces; piece++){
+      if(depth < 2 && rand() % 5 == 0){
+        out[(*used)++] = '(';
+        randomPattern(out, used, depth + 1);
+        out[(*used)++] = ')';
+      } else {
+        const char *atom = atoms[rand() % 6];
+        memcpy(out + *used, atom, strlen(atom));
+        *used += strlen(atom);
+      }
+      int repeat = rand() % 6;
+      if(repeat < 3) out[(*used)++] = "*+?"[repeat];
+    }
+  }
+}
+
+int checkRandom(unsigned int seed){
+  /***
+   * Compare random patterns and texts with the C library's POSIX regex, returns the number that differed
+   */
+  char pattern[1024], text[RANDOM_TEXT + 1], got[MAX_RESULT], want[MAX_RESULT];
+  int failed = 0;
+  srand(seed);
+  for(int i = 0; i < RANDOM_CASES; i++){
+    size_t used = 0;
+    if(rand() % 4 == 0) pattern[used++] = '^';
+    randomPattern(pattern, &used, 0);
+    if(rand() % 4 == 0) pattern[used++] = '$';
+    pattern[used] = '\0';
+    int length = rand() % (RANDOM_TEXT + 1);
+    for(int j = 0; j < length; j++) text[j] = "aab\nc"[rand() % 5];
+    text[length] = '\0';
+
+    regex_t posix;
+    if(regcomp(&posix, pattern, REG_EXTENDED | REG_NEWLINE) != 0){
+      printf("random case %d: the C library can't compile %s\n", i, pattern);
+      failed++;
+      continue;
+    }
+    posixMatches(&posix, text, want, sizeof(want));
+    regfree(&posix);
+    if(findMatches(pattern, text, got, sizeof(got)) != 0 || strcmp(got, want) != 0){
+      printf("random case %d: /%s/ on \"", i, pattern);
+      for(char *c = text; *c != '\0'; c++) printf(*c == '\n' ? "\\n" : "%c", *c);
+      printf("\" found %s, expected %s\n", got, want);
+      failed++;
+    }
+  }
+  return failed;
+}
+
+int main(int argc, char *argv[]){
+  unsigned int seed = argc > 1 ? (unsigned int)strtoul(argv[1], NULL, 10) : 1;
+  char got[MAX_RESULT];
+  int failed = 0;
+  int numCases = sizeof(cases) / sizeof(cases[0]);
+  for(int i = 0; i < numCases; i++){
+    findMatches(cases[i].pattern, cases[i].text, got, sizeof(got));
+    if(strcmp(got, cases[i].expected) != 0){
+      printf("/%s/: found \"%s\", expected \"%s\"\n", cases[i].pattern, got, cases[i].expected);
+      failed++;
+    }
+  }
+  int randomFailed = checkRandom(seed);
+  printf("regexcheck: %d of %d table cases and %d of %d random cases (seed %u) failed\n", failed, numCases,
+         randomFailed, RANDOM_CASES, seed);
+  return failed + randomFailed > 0;
+}
@@ -0,0 +1,628 @@
+/*** Includes ***/
+#include "regexdfa.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*** Defines ***/
+#define MAX_DFA_STATES 1024 //once a DFA has this many states it is thrown away and built again as the text needs it
+#define DFA_TABLE_SIZE (2 * MAX_DFA_STATES) //slots in the table that finds a DFA state by its set of NFA states
+#define DFA_MATCH 1 //the state has matched
+#define DFA_MATCH_AT_END 2 //the state has matched if the line ends here, which also satisfies any $ it is waiting on
+#define DFA_DEAD 4 //no NFA state is left, nothing can match from here on
+
+enum { AST_CLASS, AST_CAT, AST_ALT, AST_STAR, AST_PLUS, AST_QUEST, AST_BOL, AST_EOL, AST_EMPTY };
+enum { NFA_CLASS, NFA_SPLIT, NFA_BOL, NFA_EOL, NFA_MATCH };
+
+/*** Structures ***/
+struct ast_node {
+  /***
+   * One node of a parsed pattern, left and right are the operands of the node(only left for a repeat)
+   * and bits is the set of bytes a class node matches
+   */
+  int type;
+  int left;
+  int right;
+  unsigned char bits[32];
+};
+
+struct parser {
+  const char *pattern;
+  int pos;
+  struct ast_node *nodes;
+  int numNodes;
+  int capacity;
+  const char *error; //what's wrong with the pattern, NULL if nothing is
+};
+
+struct nfa_state {
+  /***
+   * A state of a Thompson NFA. A class state moves to out on any byte in bits, a split state goes to both out
+   * and out1 without reading anything, and ^ and $ states go to out only at the start or end of a line
+   */
+  int type;
+  int out;
+  int out1;
+  unsigned char bits[32];
+};
+
+struct nfa {
+  struct nfa_state *states;
+  int numStates;
+  int capacity;
+  int start;
+};
+
+struct dfa {
+  /***
+   * A DFA built lazily from an NFA. Every DFA state is a sorted set of the NFA states the NFA could be in, only
+   * class, $ and match states are kept in a set since the rest are followed right away. A transition is
+   * worked out the first time some text takes it and then read straight out of next from then on
+   * 1. unanchored - 1 if a match can start at any byte, the NFA's start is added back in after every byte
+   * 2. next - 256 transitions per state, -1 for the ones not taken yet
+   * 3. flags - DFA_MATCH, DFA_MATCH_AT_END, and DFA_DEAD for every state
+   * 4. sets, setStart, setLen - The NFA states of every DFA state
+   * 5. table - Finds a state from its set, holds state + 1 and 0 for an empty slot
+   * 6. start - The state at the start of a line and anywhere else, -1 until it is needed
+   * 7. list, onList, generation - Scratch space for working out a set
+   */
+  struct nfa *nfa;
+  int unanchored;
+  int numStates;
+  int capacity;
+  int *next;
+  unsigned char *flags;
+  int *setStart;
+  int *setLen;
+  int *sets;
+  int setsLen;
+  int setsCapacity;
+  int table[DFA_TABLE_SIZE];
+  int start[2];
+  int *list;
+  unsigned int *onList;
+  unsigned int generation;
+  int flushes; //number of times the states were thrown away
+};
+
+struct regex {
+  /***
+   * A compiled pattern. The forward DFA finds how far a match that starts at some byte goes, the reverse DFA
+   * runs the pattern backwards over the text to find every byte a match starts at in one pass
+   */
+  struct nfa forward;
+  struct nfa reverse;
+  struct dfa forwardDfa;
+  struct dfa reverseDfa;
+  unsigned char *marks; //1 for every byte of the last text marked that a match starts at
+  size_t marksCapacity;
+};
+
+/*** Parsing ***/
+void* allocOrDie(size_t size){
+  /***
+   * malloc that gives up on the program if there's no memory left, like the rest of the editor does
+   */
+  void *p = malloc(size);
+  if(p == NULL){
+    printf("Memory allocation failed\n");
+    exit(1);
+  }
+  return p;
+}
+
+int newNode(struct parser *p, int type, int left, int right){
+  /***
+   * Add a node to the parsed pattern and return its index
+   */
+  if(p->numNodes == p->capacity){
+    p->capacity = p->capacity < 16 ? 16 : p->capacity * 2;
+    p->nodes = realloc(p->nodes, sizeof(struct ast_node) * p->capacity);
+    if(p->nodes == NULL){
+      printf("Memory allocation failed\n");
+      exit(1);
+    }
+  }
+  struct ast_node *node = &p->nodes[p->numNodes];
+  node->type = type;
+  node->left = left;
+  node->right = right;
+  memset(node->bits, 0, sizeof(node->bits));
+  return p->numNodes++;
+}
+
+void setBit(unsigned char *bits, int c){
+  bits[c >> 3] |= 1 << (c & 7);
+}
+
+int escapeClass(char c, unsigned char *bits){
+  /***
+   * Add the bytes of the class \c to bits, returns 0 if \c isn't a class and just stands for c
+   */
+  unsigned char set[32] = {0};
+  char lower = c | 0x20;
+  if(lower != 'd' && lower != 'w' && lower != 's') return 0;
+  for(int b = 0; b < 256; b++){
+    int in = (b >= '0' && b <= '9');
+    if(lower == 'w') in = in || (b >= 'a' && b <= 'z') || (b >= 'A' && b <= 'Z') || b == '_';
+    if(lower == 's') in = b == ' ' || b == '\t' || b == '\r' || b == '\f' || b == '\v';
+    if(in) setBit(set, b);
+  }
+  for(int i = 0; i < 32; i++) bits[i] |= c == lower ? set[i] : (unsigned char)~set[i]; //\D \W \S are the other bytes
+  return 1;
+}
+
+char escapedChar(char c){
+  /***
+   * The byte \c stands for when it isn't a class
+   */
+  if(c == 't') return '\t';
+  if(c == 'r') return '\r';
+  return c;
+}
+
+int parseAlt(struct parser *p);
+
+int parseClass(struct parser *p){
+  /***
+   * Parse a [class] or [^negated class], p->pos is just past the [
+   */
+  int node = newNode(p, AST_CLASS, -1, -1);
+  unsigned char bits[32] = {0};
+  int negate = p->pattern[p->pos] == '^';
+  if(negate) p->pos++;
+  int first = 1;
+  while(p->pattern[p->pos] != ']' || first){ //a ] right at the start is just a ]
+    char c = p->pattern[p->pos++];
+    first = 0;
+    if(c == '\0'){
+      p->error = "missing ]";
+      return node;
+    }
+    if(c == '\\'){
+      c = p->pattern[p->pos++];
+      if(c == '\0'){
+        p->error = "pattern ends with \\";
+        return node;
+      }
+      if(escapeClass(c, bits)) continue;
+      c = escapedChar(c);
+    }
+    char last = c;
+    if(p->pattern[p->pos] == '-' && p->pattern[p->pos + 1] != ']' && p->pattern[p->pos + 1] != '\0'){ //a range like a-z
+      p->pos++;
+      last = p->pattern[p->pos++];
+      if(last == '\\') last = escapedChar(p->pattern[p->pos++]);
+    }
+    for(int b = (unsigned char)c; b <= (unsigned char)last; b++) setBit(bits, b);
+  }
+  p->pos++; //skip the ]
+  for(int i = 0; i < 32; i++) p->nodes[node].bits[i] = negate ? ~bits[i] : bits[i];
+  return node;
+}
+
+int parseAtom(struct parser *p){
+  /***
+   * Parse one thing a repeat can apply to: a byte, a class, an anchor, or a (group)
+   */
+  char c = p->pattern[p->pos++];
+  int node;
+  switch(c){
+  case '(':
+    node = parseAlt(p);
+    if(p->pattern[p->pos] != ')'){
+      if(p->error == NULL) p->error = "missing )";
+      return node;
+    }
+    p->pos++;
+    return node;
+  case '[':
+    return parseClass(p);
+  case '^':
+    return newNode(p, AST_BOL, -1, -1);
+  case '$':
+    return newNode(p, AST_EOL, -1, -1);
+  case '*':
+  case '+':
+  case '?':
+    p->error = "nothing to repeat";
+    return newNode(p, AST_EMPTY, -1, -1);
+  case '.':
+    node = newNode(p, AST_CLASS, -1, -1);
+    memset(p->nodes[node].bits, 0xff, 32);
+    return node;
+  case '\\':
+    c = p->pattern[p->pos++];
+    if(c == '\0'){
+      p->error = "pattern ends with \\";
+      return newNode(p, AST_EMPTY, -1, -1);
+    }
+    node = newNode(p, AST_CLASS, -1, -1);
+    if(!escapeClass(c, p->nodes[node].bits)) setBit(p->nodes[node].bits, (unsigned char)escapedChar(c));
+    return node;
+  default:
+    node = newNode(p, AST_CLASS, -1, -1);
+    setBit(p->nodes[node].bits, (unsigned char)c);
+    return node;
+  }
+}
+
+int parseRepeat(struct parser *p){
+  /***
+   * Parse an atom followed by any number of * + ?
+   */
+  int node = parseAtom(p);
+  while(p->error == NULL){
+    char c = p->pattern[p->pos];
+    int type = c == '*' ? AST_STAR : c == '+' ? AST_PLUS : c == '?' ? AST_QUEST : -1;
+    if(type == -1) break;
+    p->pos++;
+    node = newNode(p, type, node, -1);
+  }
+  return node;
+}
+
+int parseConcat(struct parser *p){
+  /***
+   * Parse repeats one after the other up to the next | or ) or the end of the pattern
+   */
+  int node = -1;
+  while(p->error == NULL){
+    char c = p->pattern[p->pos];
+    if(c == '\0' || c == '|' || c == ')') break;
+    int next = parseRepeat(p);
+    node = node == -1 ? next : newNode(p, AST_CAT, node, next);
+  }
+  return node == -1 ? newNode(p, AST_EMPTY, -1, -1) : node;
+}
+
+int parseAlt(struct parser *p){
+  /***
+   * Parse alternatives separated by |
+   */
+  int node = parseConcat(p);
+  while(p->error == NULL && p->pattern[p->pos] == '|'){
+    p->pos++;
+    node = newNode(p, AST_ALT, node, parseConcat(p));
+  }
+  return node;
+}
+
+/*** NFA ***/
+int nfaAdd(struct nfa *nfa, int type, int out, int out1, const unsigned char *bits){
+  /***
+   * Add a state to an NFA and return its index
+   */
+  if(nfa->numStates == nfa->capacity){
+    nfa->capacity = nfa->capacity < 16 ? 16 : nfa->capacity * 2;
+    nfa->states = realloc(nfa->states, sizeof(struct nfa_state) * nfa->capacity);
+    if(nfa->states == NULL){
+      printf("Memory allocation failed\n");
+      exit(1);
+    }
+  }
+  struct nfa_state *state = &nfa->states[nfa->numStates];
+  state->type = type;
+  state->out = out;
+  state->out1 = out1;
+  if(bits != NULL) memcpy(state->bits, bits, 32);
+  return nfa->numStates++;
+}
+
+int nfaBuild(struct nfa *nfa, struct ast_node *nodes, int node, int next, int reverse){
+  /***
+   * Build the states for a parsed node so that they carry on to next once the node has matched, and return the
+   * state to enter them at. With reverse set the NFA matches the pattern backwards, so concatenations are built
+   * the other way around and ^ and $ swap places
+   */
+  struct ast_node *n = &nodes[node];
+  int split, body;
+  switch(n->type){
+  case AST_CLASS:
+    return nfaAdd(nfa, NFA_CLASS, next, -1, n->bits);
+  case AST_CAT:
+    if(reverse) return nfaBuild(nfa, nodes, n->right, nfaBuild(nfa, nodes, n->left, next, reverse), reverse);
+    return nfaBuild(nfa, nodes, n->left, nfaBuild(nfa, nodes, n->right, next, reverse), reverse);
+  case AST_ALT:
+    split = nfaBuild(nfa, nodes, n->left, next, reverse);
+    return nfaAdd(nfa, NFA_SPLIT, split, nfaBuild(nfa, nodes, n->right, next, reverse), NULL);
+  case AST_STAR:
+    split = nfaAdd(nfa, NFA_SPLIT, -1, next, NULL);
+    body = nfaBuild(nfa, nodes, n->left, split, reverse);
+    nfa->states[split].out = body;
+    return split;
+  case AST_PLUS:
+    split = nfaAdd(nfa, NFA_SPLIT, -1, next, NULL);
+    body = nfaBuild(nfa, nodes, n->left, split, reverse);
+    nfa->states[split].out = body;
+    return body;
+  case AST_QUEST:
+    return nfaAdd(nfa, NFA_SPLIT, nfaBuild(nfa, nodes, n->left, next, reverse), next, NULL);
+  case AST_BOL:
+    return nfaAdd(nfa, reverse ? NFA_EOL : NFA_BOL, next, -1, NULL);
+  case AST_EOL:
+    return nfaAdd(nfa, reverse ? NFA_BOL : NFA_EOL, next, -1, NULL);
+  default:
+    return next;
+  }
+}
+
+/*** Lazy DFA ***/
+void dfaInit(struct dfa *d, struct nfa *nfa, int unanchored){
+  memset(d, 0, sizeof(*d));
+  d->nfa = nfa;
+  d->unanchored = unanchored;
+  d->start[0] = -1;
+  d->start[1] = -1;
+  d->list = allocOrDie(sizeof(int) * nfa->numStates);
+  d->onList = calloc(nfa->numStates, sizeof(unsigned int));
+  if(d->onList == NULL){
+    printf("Memory allocation failed\n");
+    exit(1);
+  }
+}
+
+void dfaFree(struct dfa *d){
+  free(d->next);
+  free(d->flags);
+  free(d->setStart);
+  free(d->setLen);
+  free(d->sets);
+  free(d->list);
+  free(d->onList);
+}
+
+void dfaFlush(struct dfa *d){
+  /***
+   * Throw away every state, used when a pattern needs more states than MAX_DFA_STATES. The text being searched
+   * carries on from the set it was in, so only the time to build the states again is lost
+   */
+  d->numStates = 0;
+  d->setsLen = 0;
+  d->start[0] = -1;
+  d->start[1] = -1;
+  memset(d->table, 0, sizeof(d->table));
+  d->flushes++;
+}
+
+void addClosure(struct dfa *d, int s, int atBegin, int *count){
+  /***
+   * Add NFA state s to the list along with every state it reaches without reading a byte. A ^ is only
+   * passed at the start of a line, a $ is kept in the set until the line is known to end
+   */
+  if(s < 0 || d->onList[s] == d->generation) return;
+  d->onList[s] = d->generation;
+  struct nfa_state *state = &d->nfa->states[s];
+  if(state->type == NFA_SPLIT){
+    addClosure(d, state->out, atBegin, count);
+    addClosure(d, state->out1, atBegin, count);
+  } else if(state->type == NFA_BOL){
+    if(atBegin) addClosure(d, state->out, atBegin, count);
+  } else {
+    d->list[(*count)++] = s;
+  }
+}
+
+int matchesAtEnd(struct dfa *d, int s){
+  /***
+   * Check if NFA state s reaches the match state at the end of a line without reading a byte
+   */
+  if(s < 0 || d->onList[s] == d->generation) return 0;
+  d->onList[s] = d->generation;
+  struct nfa_state *state = &d->nfa->states[s];
+  if(state->type == NFA_MATCH) return 1;
+  if(state->type == NFA_SPLIT) return matchesAtEnd(d, state->out) || matchesAtEnd(d, state->out1);
+  if(state->type == NFA_EOL) return matchesAtEnd(d, state->out);
+  return 0;
+}
+
+int compareInts(const void *a, const void *b){
+  return *(const int *)a - *(const int *)b;
+}
+
+int dfaState(struct dfa *d, int count){
+  /***
+   * Returns the DFA state for the set of count NFA states in the list, making it if it's new. Returns -1 if
+   * the DFA is full
+   */
+  qsort(d->list, count, sizeof(int), compareInts);
+  unsigned int hash = 2166136261u;
+  for(int i = 0; i < count; i++) hash = (hash ^ (unsigned int)d->list[i]) * 16777619u;
+  unsigned int slot = hash & (DFA_TABLE_SIZE - 1);
+  for(; d->table[slot] != 0; slot = (slot + 1) & (DFA_TABLE_SIZE - 1)){
+    int id = d->table[slot] - 1;
+    if(d->setLen[id] == count && memcmp(d->sets + d->setStart[id], d->list, sizeof(int) * count) == 0) return id;
+  }
+  if(d->numStates == MAX_DFA_STATES) return -1;
+
+  int id = d->numStates++;
+  if(id == d->capacity){
+    d->capacity = d->capacity < 16 ? 16 : d->capacity * 2;
+    d->next = realloc(d->next, sizeof(int) * 256 * d->capacity);
+    d->flags = realloc(d->flags, d->capacity);
+    d->setStart = realloc(d->setStart, sizeof(int) * d->capacity);
+    d->setLen = realloc(d->setLen, sizeof(int) * d->capacity);
+    if(d->next == NULL || d->flags == NULL || d->setStart == NULL || d->setLen == NULL){
+      printf("Memory allocation failed\n");
+      exit(1);
+    }
+  }
+  if(d->setsLen + count > d->setsCapacity){
+    d->setsCapacity = d->setsLen + count > 2 * d->setsCapacity ? d->setsLen + count : 2 * d->setsCapacity;
+    d->sets = realloc(d->sets, sizeof(int) * d->setsCapacity);
+    if(d->sets == NULL){
+      printf("Memory allocation failed\n");
+      exit(1);
+    }
+  }
+  memcpy(d->sets + d->setsLen, d->list, sizeof(int) * count);
+  d->setStart[id] = d->setsLen;
+  d->setLen[id] = count;
+  d->setsLen += count;
+  memset(d->next + 256 * id, 0xff, sizeof(int) * 256);
+  d->table[slot] = id + 1;
+
+  int flags = count == 0 && !d->unanchored ? DFA_DEAD : 0;
+  d->generation++;
+  for(int i = 0; i < count; i++){
+    int type = d->nfa->states[d->list[i]].type;
+    if(type == NFA_MATCH) flags |= DFA_MATCH | DFA_MATCH_AT_END;
+    if(type == NFA_EOL && matchesAtEnd(d, d->list[i])) flags |= DFA_MATCH_AT_END;
+  }
+  d->flags[id] = flags;
+  return id;
+}
+
+int dfaAdd(struct dfa *d, int count){
+  /***
+   * Returns the DFA state for the set in the list, starting the DFA over if it is full
+   */
+  int id = dfaState(d, count);
+  if(id < 0){
+    dfaFlush(d);
+    id = dfaState(d, count);
+  }
+  return id;
+}
+
+int dfaStart(struct dfa *d, int atBegin){
+  /***
+   * Returns the state a search starts in, at the start of a line if atBegin is 1
+   */
+  if(d->start[atBegin] >= 0) return d->start[atBegin];
+  int count = 0;
+  d->generation++;
+  addClosure(d, d->nfa->start, atBegin, &count);
+  int id = dfaAdd(d, count);
+  d->start[atBegin] = id;
+  return id;
+}
+
+int dfaStep(struct dfa *d, int state, unsigned char c){
+  /***
+   * Work out the transition out of state on byte c the first time it is taken
+   */
+  int count = 0;
+  d->generation++;
+  int *set = d->sets + d->setStart[state];
+  for(int i = 0; i < d->setLen[state]; i++){
+    struct nfa_state *s = &d->nfa->states[set[i]];
+    if(s->type == NFA_CLASS && (s->bits[c >> 3] & (1 << (c & 7)))) addClosure(d, s->out, 0, &count);
+  }
+  if(d->unanchored) addClosure(d, d->nfa->start, 0, &count);
+  int flushes = d->flushes;
+  int id = dfaAdd(d, count);
+  if(d->flushes == flushes) d->next[256 * state + c] = id; //after a flush state is gone, the transition isn't kept
+  return id;
+}
+
+/*** Regex ***/
+struct regex* regexCompile(const char *pattern, const char **error){
+  /***
+   * Compile a pattern, returns NULL and points error at what's wrong if the pattern can't be parsed
+   */
+  struct parser p = {pattern, 0, NULL, 0, 0, NULL};
+  int root = parseAlt(&p);
+  if(p.error == NULL && p.pattern[p.pos] != '\0') p.error = "unmatched )";
+  if(p.error != NULL){
+    *error = p.error;
+    free(p.nodes);
+    return NULL;
+  }
+  struct regex *re = calloc(1, sizeof(struct regex));
+  if(re == NULL){
+    printf("Memory allocation failed\n");
+    exit(1);
+  }
+  int match = nfaAdd(&re->forward, NFA_MATCH, -1, -1, NULL);
+  re->forward.start = nfaBuild(&re->forward, p.nodes, root, match, 0);
+  match = nfaAdd(&re->reverse, NFA_MATCH, -1, -1, NULL);
+  re->reverse.start = nfaBuild(&re->reverse, p.nodes, root, match, 1);
+  free(p.nodes);
+  dfaInit(&re->forwardDfa, &re->forward, 0);
+  dfaInit(&re->reverseDfa, &re->reverse, 1);
+  return re;
+}
+
+void regexFree(struct regex *re){
+  if(re == NULL) return;
+  dfaFree(&re->forwardDfa);
+  dfaFree(&re->reverseDfa);
+  free(re->forward.states);
+  free(re->reverse.states);
+  free(re->marks);
+  free(re);
+}
+
+void regexMarkStarts(struct regex *re, const char *text, size_t len){
+  /***
+   * Find every byte of text a match starts at, by running the reversed pattern from the end of the text to the
+   * start. The reversed pattern may start matching anywhere, so whenever it is in a matching state some match
+   * of the pattern starts at the byte it just read. This has to be done before regexNext is used on the text
+   */
+  if(len + 1 > re->marksCapacity){
+    re->marksCapacity = len + 1 > 2 * re->marksCapacity ? len + 1 : 2 * re->marksCapacity;
+    free(re->marks);
+    re->marks = allocOrDie(re->marksCapacity);
+  }
+  struct dfa *d = &re->reverseDfa;
+  int state = dfaStart(d, 1); //running backwards the text starts at the end of its last line
+  int *next = d->next;
+  unsigned char *flags = d->flags;
+  for(size_t i = len; i > 0; i--){
+    unsigned char c = text[i - 1];
+    if(c == '\n'){ //i starts a line, and the line before it is read from its end
+      re->marks[i] = (flags[state] & DFA_MATCH_AT_END) != 0;
+      state = dfaStart(d, 1);
+      next = d->next;
+      flags = d->flags;
+      continue;
+    }
+    re->marks[i] = flags[state] & DFA_MATCH;
+    int to = next[256 * state + c];
+    if(to < 0){ //a new transition, building it can move the tables
+      to = dfaStep(d, state, c);
+      next = d->next;
+      flags = d->flags;
+    }
+    state = to;
+  }
+  re->marks[0] = (d->flags[state] & DFA_MATCH_AT_END) != 0;
+}
+
+int regexNext(struct regex *re, const char *text, size_t len, size_t from, size_t *start, size_t *end){
+  /***
+   * Find the first match that starts at or after from, using the starts regexMarkStarts found. The match is the
+   * longest one starting at the first marked byte, empty matches are skipped. Returns 0 if there isn't one
+   */
+  struct dfa *d = &re->forwardDfa;
+  while(from <= len){
+    unsigned char *mark = memchr(re->marks + from, 1, len + 1 - from);
+    if(mark == NULL) return 0;
+    size_t s = mark - re->marks;
+    int state = dfaStart(d, s == 0 || text[s - 1] == '\n');
+    size_t last = s;
+    for(size_t j = s; ; j++){
+      int atLineEnd = j == len || text[j] == '\n';
+      if(d->flags[state] & (atLineEnd ? DFA_MATCH_AT_END : DFA_MATCH)) last = j;
+      if(atLineEnd || (d->flags[state] & DFA_DEAD)) break;
+      unsigned char c = text[j];
+      int next = d->next[256 * state + c];
+      state = next >= 0 ? next : dfaStep(d, state, c);
+    }
+    if(last > s){
+      *start = s;
+      *end = last;
+      return 1;
+    }
+    from = s + 1;
+  }
+  return 0;
+}
+
+int regexStates(struct regex *re){
+  /***
+   * Number of DFA states built so far, for the benchmark
+   */
+  return re->forwardDfa.numStates + re->reverseDfa.numStates;
+}
@@ -0,0 +1,20 @@
+#ifndef REGEXDFA_H
+#define REGEXDFA_H
+#include <stddef.h>
+
+/***
+ * A small regular expression engine for searching. Patterns support literals, ., [classes], [^negated classes],
+ * \d \w \s and their capitals, * + ?, |, (groups), and ^ $ for the start and end of a line. A pattern is compiled
+ * into an NFA once, and the NFA is turned into a DFA lazily, one state at a time as the text needs them, so
+ * every byte searched costs one table lookup and nothing is ever backtracked. Matches never cross a \n,
+ * so a block of many lines can be searched at once
+ */
+struct regex;
+
+struct regex* regexCompile(const char *, const char **);
+void regexFree(struct regex *);
+void regexMarkStarts(struct regex *, const char *, size_t);
+int regexNext(struct regex *, const char *, size_t, size_t, size_t *, size_t *);
+int regexStates(struct regex *);
+
+#endif